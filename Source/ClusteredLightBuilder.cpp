@@ -1,7 +1,7 @@
 #include "ClusteredLightBuilder.h"
+#include "OcclusionCulling.h"
 #include "Utils.h"
 
-#include <Rush/GfxDevice.h>
 #include <Rush/UtilTimer.h>
 
 #include <algorithm>
@@ -9,46 +9,83 @@
 ClusteredLightBuilder::ClusteredLightBuilder(u32 maxLights)
 : m_maxLights(maxLights), m_lightIntervals(maxLights), m_lightScreenSpaceExtents(maxLights)
 {
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = 0;
-		bufferDesc.stride = 4;
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_R16_Uint;
-		m_lightIndexBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+}
 
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = 0;
-		bufferDesc.stride = (u32)sizeof(LightGridCell);
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_Unknown;
-		m_lightGridBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+ClusteredLightBuildResult ClusteredLightBuilder::build(
+    const Camera& camera, const std::vector<LightSource>& viewSpaceLights, const BuildParams& buildParams)
+{
+	ClusteredLightBuildResult result;
+	Timer                     timer;
+
+	const FrustumPlanes frustum(camera.buildProjMatrix());
+
+	m_gpuLights.clear();
+
+	result.lightCullTime -= timer.time();
+	m_lightSpheres.build(viewSpaceLights);
+	performLightCullingAndComputeDepthIntervals(frustum, m_lightSpheres, m_visibleLightIndices, m_lightIntervals);
+	result.lightCullTime += timer.time();
+
+	buildFromLightIntervals(camera, viewSpaceLights, buildParams, timer, result);
+
+	return result;
 }
 
-ClusteredLightBuildResult ClusteredLightBuilder::build(GfxContext* ctx,
-    const Camera&                                                  camera,
-    const std::vector<LightSource>&                                viewSpaceLights,
-    const BuildParams&                                             buildParams)
+ClusteredLightBuildResult ClusteredLightBuilder::build(const Camera& camera, const Mat4& matView,
+    const std::vector<AnimatedLightSource>& worldSpaceLights, u32 lightCount, const BuildParams& buildParams)
 {
-	m_lightDataSize = 0;
-	m_lightGridSize = 0;
+	ClusteredLightBuildResult result;
+	Timer                     timer;
+
+	const FrustumPlanes worldSpaceFrustum(matView * camera.buildProjMatrix());
+
+	lightCount = min<u32>(lightCount, (u32)worldSpaceLights.size());
+
+	result.lightCullTime -= timer.time();
+	performLightCullingAndTransform(worldSpaceFrustum, matView, worldSpaceLights.data(), lightCount,
+	    m_visibleLightIndices, m_lightIntervals, m_gpuLights);
+	result.lightCullTime += timer.time();
+
+	buildFromLightIntervals(camera, m_gpuLights, buildParams, timer, result);
+
+	return result;
+}
+
+ClusteredLightBuildResult ClusteredLightBuilder::build(const Camera& camera, const Mat4& matView,
+    const std::vector<AnimatedLightSource>& worldSpaceLights, const LightBvh& lightBvh, const BuildParams& buildParams)
+{
+	RUSH_ASSERT(lightBvh.getLightCount() <= worldSpaceLights.size());
 
 	ClusteredLightBuildResult result;
 	Timer                     timer;
 
-	const Vec2           resolutionF = Vec2((float)buildParams.resolution.x, (float)buildParams.resolution.y);
-	const GfxCapability& caps        = Gfx_GetCapability();
+	const FrustumPlanes worldSpaceFrustum(matView * camera.buildProjMatrix());
+
+	result.lightCullTime -= timer.time();
+	lightBvh.cull(worldSpaceFrustum, m_visibleLightIndices);
+	transformVisibleLights(matView, worldSpaceLights.data(), m_visibleLightIndices, m_lightIntervals, m_gpuLights);
+	result.lightCullTime += timer.time();
+
+	buildFromLightIntervals(camera, m_gpuLights, buildParams, timer, result);
+
+	return result;
+}
+
+void ClusteredLightBuilder::buildFromLightIntervals(const Camera& camera,
+    const std::vector<LightSource>& viewSpaceLights, const BuildParams& buildParams, Timer& timer,
+    ClusteredLightBuildResult& result)
+{
+	m_lightDataSize = 0;
+	m_lightGridSize = 0;
+
+	const Vec2 resolutionF = Vec2((float)buildParams.resolution.x, (float)buildParams.resolution.y);
 
 	const Mat4 matProj = camera.buildProjMatrix();
 
 	const float cameraNearZ = camera.getNearPlane();
 
-	const Frustum frustum(matProj);
-	const Vec3    cameraPosition = camera.getPosition();
-	const Vec3    cameraForward  = camera.getForward();
+	const Vec3 cameraPosition = camera.getPosition();
+	const Vec3 cameraForward  = camera.getForward();
 
 	// assign lights to tiles
 
@@ -60,18 +97,14 @@ ClusteredLightBuildResult ClusteredLightBuilder::build(GfxContext* ctx,
 	m_tileLightCount.clear();
 	m_tileLightCount.resize(tilesPerSlice);
 
-	m_lightGrid.resize(cellCount);
-
-	memset(m_lightGrid.data(), 0, sizeof(LightGridCell) * cellCount);
-
-	m_cellLightCount.clear();
-	m_cellLightCount.resize(cellCount, 0);
-
 	m_lightScreenSpaceExtents.m_count = viewSpaceLights.size();
 
-	result.lightCullTime -= timer.time();
-	performLightCullingAndComputeDepthIntervals(frustum, viewSpaceLights, m_visibleLightIndices, m_lightIntervals);
-	result.lightCullTime += timer.time();
+	if (buildParams.occlusionBuffer)
+	{
+		result.lightCullTime -= timer.time();
+		cullOccludedLights(*buildParams.occlusionBuffer, viewSpaceLights, m_lightIntervals, m_lightIntervalsTemp);
+		result.lightCullTime += timer.time();
+	}
 
 	result.visibleLightCount = (u32)m_lightIntervals.size();
 
@@ -83,103 +116,89 @@ ClusteredLightBuildResult ClusteredLightBuilder::build(GfxContext* ctx,
 	    matProj * Mat4::scaleTranslate(Vec3(0.5f * resolutionF.x, -0.5f * resolutionF.y, 1.0f),
 	                  Vec3(0.5f * resolutionF.x, 0.5f * resolutionF.y, 0.0f));
 
-	performLightBinning(depthExtentsCalculator, matProjScreenSpace, cameraNearZ, buildParams.tileSize, tileCountX,
-	    tileCountY, viewSpaceLights, m_lightIntervals, m_lightScreenSpaceExtents.data(), m_cellLightCount.data());
+	m_tileFrustumCache.build(
+	    camera.getFov(), camera.getAspect(), buildParams.tileSize, tileCountX, tileCountY, buildParams.resolution.x);
 
-	for (size_t cellIndex = 0; cellIndex < m_cellLightCount.size(); ++cellIndex)
-	{
-		m_lightGrid[cellIndex].lightCount = m_cellLightCount[cellIndex];
-	}
+	const u32 assignedLightCount = m_lightBinning.count(depthExtentsCalculator, matProjScreenSpace, cameraNearZ,
+	    buildParams.tileSize, tileCountX, tileCountY, buildParams.sliceCount, viewSpaceLights, m_lightIntervals,
+	    m_lightScreenSpaceExtents.data(), buildParams.useTileFrustumCulling ? &m_tileFrustumCache : nullptr,
+	    buildParams.tileDepthRanges, buildParams.activeClusterMask, buildParams.useTileRowSpans,
+	    buildParams.useClusterCulling);
 
-	if (buildParams.calculateTileLightCount)
+	m_gpuLightIndices.resize(assignedLightCount);
+
+	m_lightBinning.scatter(m_lightIntervals, m_lightScreenSpaceExtents.data(), m_gpuLightIndices.data(),
+	    [&](u32 intervalIndex) { return (u16)m_lightIntervals[intervalIndex].lightIndex; });
+
+	if (buildParams.maxLightsPerCell)
 	{
-		for (size_t cellIndex = 0; cellIndex < m_lightGrid.size(); ++cellIndex)
-		{
-			const auto& cell = m_lightGrid[cellIndex];
+		computeLightImportance(viewSpaceLights, m_lightIntervals, m_lightImportance);
 
-			u32 cellX = (cellIndex % tilesPerSlice) % tileCountX;
-			u32 cellY = (cellIndex % tilesPerSlice) / tileCountX;
+		const LightCapStats capStats = m_lightBinning.capCells(m_gpuLightIndices.data(), buildParams.maxLightsPerCell,
+		    [&](u16 lightIndex) { return m_lightImportance[lightIndex]; });
 
-			u32 tileIndex = cellX + cellY * tileCountX;
+		m_gpuLightIndices.resize(m_lightBinning.getCellOffset(cellCount));
 
-			m_tileLightCount[tileIndex] += m_lightGrid[cellIndex].lightCount;
-		}
+		result.cappedLightCount = capStats.removedCount;
+		result.cappedImportance = capStats.getRemovedImportanceRatio();
 	}
 
-	u32 assignedLightCount = 0;
-	for (auto& cell : m_lightGrid)
-	{
-		cell.lightOffset = assignedLightCount;
-		assignedLightCount += cell.lightCount;
-		cell.lightCount = 0;
-	}
+	// With a mask, only active clusters get grid cells and shaders look them up through the remap table, where
+	// inactive clusters share the empty grid cell 0. Otherwise the grid has a cell for every cluster and no remap table.
 
-	m_gpuLightIndices.resize(assignedLightCount);
+	static constexpr u32 CellsPerTask = 4096;
 
-	const float yHeight                    = tan(camera.getFov() / 2) * 2;
-	const float xWidth                     = yHeight * camera.getAspect();
-	const Vec2  cameraFrustumTopLeftCorner = Vec2(-xWidth / 2, yHeight / 2);
-	const float tileFrustumStepSize        = xWidth * float(buildParams.tileSize) / float(buildParams.resolution.x);
-	const Vec2  tileStep                   = Vec2(tileFrustumStepSize, -tileFrustumStepSize);
+	const u32* activeClusterMask = buildParams.activeClusterMask;
 
-	m_tileFrustumCache.build(
-	    camera.getFov(), camera.getAspect(), buildParams.tileSize, tileCountX, tileCountY, buildParams.resolution.x);
+	if (activeClusterMask)
+	{
+		m_lightGridRemap.resize(cellCount);
+
+		const u32 activeCellCount = parallelExclusiveScan<u32>(
+		    cellCount, CellsPerTask, [&](u32 cellIndex) { return u32(isCellActive(activeClusterMask, cellIndex)); },
+		    [&](u32 cellIndex, u32 offset) {
+			    m_lightGridRemap[cellIndex] = isCellActive(activeClusterMask, cellIndex) ? offset + 1 : 0;
+		    });
+
+		m_lightGrid.resize(activeCellCount + 1);
 
-	parallelForEach(m_lightIntervals.begin(), m_lightIntervals.end(), [&](const LightDepthInterval& interval) {
-		const LightTileDepthExtents&       depthExtents       = interval.depthExtents;
-		const LightTileScreenSpaceExtents& screenSpaceExtents = m_lightScreenSpaceExtents[interval.lightIndex];
+		memset(&m_lightGrid[0], 0, sizeof(LightGridCell));
+	}
+	else
+	{
+		m_lightGridRemap.clear();
 
-		const LightSource& light        = viewSpaceLights[interval.lightIndex];
-		const Vec4         lightSphere  = Vec4(light.position, light.attenuationEnd);
-		const Vec2 tileSpaceLightCenter = screenSpaceExtents.screenSpaceBox.center() / float(buildParams.tileSize);
+		m_lightGrid.resize(cellCount);
+	}
 
-		for (u32 y = screenSpaceExtents.tileMin.y; y <= screenSpaceExtents.tileMax.y; ++y)
+	parallelFor<u32>(0, cellCount, [&](u32 cellIndex) {
+		const u32 gridCellIndex = activeClusterMask ? m_lightGridRemap[cellIndex] : cellIndex;
+		if (activeClusterMask && gridCellIndex == 0)
 		{
-			for (u32 x = screenSpaceExtents.tileMin.x; x <= screenSpaceExtents.tileMax.x; ++x)
-			{
-				if (buildParams.useTileFrustumCulling)
-				{
-					u32         tileId  = x + y * tileCountX;
-					const Vec3* corners = &m_tileFrustumCache.m_corners[tileId * 4];
-					const Vec3* planes  = &m_tileFrustumCache.m_planes[tileId * 4];
-
-					// const Vec2 tileTopLeft = Vec2(float(x), float(y));
-					// TODO: implement culling on Z axis as well
-					// if (!testTileFrustumSphereFastButInaccurate(cameraFrustumTopLeftCorner, tileStep, tileTopLeft,
-					// tileSpaceLightCenter, lightSphere))
-					if (!testTileFrustumSphere(corners, planes, lightSphere))
-					{
-						continue;
-					}
-				}
-
-				for (u32 z = depthExtents.sliceMin; z <= depthExtents.sliceMax; ++z)
-				{
-					u32            cellIndex = x + y * tileCountX + z * tilesPerSlice;
-					LightGridCell& cell      = m_lightGrid[cellIndex];
-
-					u32 writeIndex = interlockedIncrement(cell.lightCount) - 1;
-					u32 offset     = cell.lightOffset + writeIndex;
-
-					m_gpuLightIndices[offset] = interval.lightIndex;
-				}
-			}
+			return;
 		}
+
+		LightGridCell& cell = m_lightGrid[gridCellIndex];
+		cell.lightOffset    = m_lightBinning.getCellOffset(cellIndex);
+		cell.lightCount     = m_lightBinning.getCellLightCount(cellIndex);
+		cell.pad0           = 0;
+		cell.pad1           = 0;
 	});
 
+	if (buildParams.calculateTileLightCount)
+	{
+		parallelFor<u32>(0, tilesPerSlice,
+		    [&](u32 tileIndex) { m_tileLightCount[tileIndex] = (u16)m_lightBinning.getTileLightCount(tileIndex); });
+	}
+
 	result.lightAssignTime += timer.time();
 
-	result.uploadTime -= timer.time();
-	m_lightGridSize = updateBufferFromArray(ctx, m_lightGridBuffer.get(), m_lightGrid);
-	m_lightDataSize += updateBufferFromArray(ctx, m_lightIndexBuffer.get(), m_gpuLightIndices);
+	// Light grid and indices are submitted to the GPU separately by ClusteredLightUploader
+
+	m_lightGridSize = u32(m_lightGrid.size() * sizeof(LightGridCell) + m_lightGridRemap.size() * sizeof(u32));
+	m_lightDataSize += u32(m_gpuLightIndices.size() * sizeof(u16));
 
-	result.uploadTime += timer.time();
 	result.totalDataSize = m_lightDataSize + m_lightGridSize;
 
 	result.buildTotalTime = timer.time();
-
-	result.lightGridBuffer  = m_lightGridBuffer.get();
-	result.lightIndexBuffer = m_lightIndexBuffer.get();
-
-	return result;
 }
@@ -1,11 +1,12 @@
 #pragma once
 
+#include "LightBvh.h"
 #include "LightingCommon.h"
 
-#include <Rush/GfxCommon.h>
 #include <Rush/MathTypes.h>
 #include <Rush/Rush.h>
 #include <Rush/UtilCamera.h>
+#include <Rush/UtilTimer.h>
 
 struct ClusteredLightBuildResult
 {
@@ -19,8 +20,8 @@ struct ClusteredLightBuildResult
 	u32 totalDataSize     = 0;
 	u32 visibleLightCount = 0;
 
-	GfxBuffer lightGridBuffer;
-	GfxBuffer lightIndexBuffer;
+	u32   cappedLightCount = 0; // cell entries removed by maxLightsPerCell
+	float cappedImportance = 0; // proportion of total importance of cell entries removed by maxLightsPerCell
 };
 
 class ClusteredLightBuilder
@@ -38,26 +39,49 @@ public:
 
 	struct BuildParams : CommonLightBuildParams
 	{
+		bool useClusterCulling = true; // also test lights against bounding boxes of clusters, needs tile frustum culling
+
+		// Optional bit mask of clusters that contain samples, e.g. from computeActiveClusterMask().
+		// Only active clusters get light grid cells and lights, which shaders have to look up through m_lightGridRemap.
+		// Must stay valid while building.
+		const u32* activeClusterMask = nullptr;
 	};
 
+	// Performs all CPU work and leaves the results in m_lightGrid, m_lightGridRemap and m_gpuLightIndices.
+	// Use ClusteredLightUploader to submit them to the GPU.
 	ClusteredLightBuildResult build(
-	    GfxContext* ctx, const Camera& camera, const std::vector<LightSource>& lights, const BuildParams& params);
+	    const Camera& camera, const std::vector<LightSource>& lights, const BuildParams& params);
+
+	// Same as above, but takes world space lights and only transforms the ones that pass frustum culling.
+	// View space copies of visible lights are left in m_gpuLights, which m_gpuLightIndices refer to.
+	ClusteredLightBuildResult build(const Camera& camera, const Mat4& matView,
+	    const std::vector<AnimatedLightSource>& worldSpaceLights, u32 lightCount, const BuildParams& params);
+
+	// Same as above, but visible lights are found by walking a BVH built over worldSpaceLights.
+	ClusteredLightBuildResult build(const Camera& camera, const Mat4& matView,
+	    const std::vector<AnimatedLightSource>& worldSpaceLights, const LightBvh& lightBvh, const BuildParams& params);
 
 	const u32 m_maxLights;
 
-	std::vector<u16>                          m_cellLightCount;
+	LightBinning                              m_lightBinning;
 	std::vector<u16>                          m_tileLightCount;
+	LightSpheresSoA                           m_lightSpheres;
 	AlignedArray<u32>                         m_visibleLightIndices;
 	AlignedArray<LightDepthInterval>          m_lightIntervals;
+	AlignedArray<LightDepthInterval>          m_lightIntervalsTemp; // temporary storage for occlusion culling
 	AlignedArray<LightTileScreenSpaceExtents> m_lightScreenSpaceExtents;
-	AlignedArray<LightGridCell>               m_lightGrid;
+	AlignedArray<LightGridCell>               m_lightGrid; // cell of every cluster, or of active ones after an empty one
+	std::vector<u32>                          m_lightGridRemap; // index into m_lightGrid for every cluster, if masked
+	std::vector<LightSource>                  m_gpuLights;
 	std::vector<u16>                          m_gpuLightIndices;
+	std::vector<float>                        m_lightImportance; // only computed if maxLightsPerCell is set
 
 	u32 m_lightDataSize = 0;
 	u32 m_lightGridSize = 0;
 
-	GfxOwn<GfxBuffer> m_lightGridBuffer;
-	GfxOwn<GfxBuffer> m_lightIndexBuffer;
-
 	TileFrustumCache m_tileFrustumCache;
+
+private:
+	void buildFromLightIntervals(const Camera& camera, const std::vector<LightSource>& viewSpaceLights,
+	    const BuildParams& buildParams, Timer& timer, ClusteredLightBuildResult& result);
 };
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Rush/GfxDevice.h>
+
+#include <vector>
+
+template <typename ArrayType> u32 updateBufferFromArray(GfxContext* rc, GfxBuffer h, const ArrayType& data)
+{
+	u32 dataSize = (u32)(data.size() * sizeof(data[0]));
+	Gfx_UpdateBuffer(rc, h, data.data(), dataSize);
+	return dataSize;
+}
+
+GfxOwn<GfxTexture> loadDDS(const char* filename);
+
+// Reads the top level of a depth DDS for use on the CPU, with values converted to floats
+bool loadDDSDepth(const char* filename, std::vector<float>& outDepth, u32& outWidth, u32& outHeight);
+GfxOwn<GfxTexture> loadBitmap(const char* filename, bool flipY = false);
+
+inline GfxOwn<GfxBuffer> Gfx_CreateConstantBuffer(GfxBufferFlags flags, u32 size, const void* data = nullptr)
+{
+	GfxBufferDesc desc(GfxBufferFlags::Constant | flags, GfxFormat_Unknown, 1, size);
+	return Gfx_CreateBuffer(desc, data);
+}
+
+inline GfxTextureData makeTextureData(const void* pixels, u32 mipLevel)
+{
+	GfxTextureData result;
+	result.pixels = pixels;
+	result.mip    = mipLevel;
+	return result;
+}
@@ -0,0 +1,105 @@
+#include "LightBuildUpload.h"
+#include "GfxUtils.h"
+
+#include <Rush/UtilTimer.h>
+
+TiledLightTreeUploader::TiledLightTreeUploader(u32 maxLights)
+{
+	{
+		GfxBufferDesc bufferDesc;
+		bufferDesc.count  = 0;
+		bufferDesc.stride = 4;
+		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
+		bufferDesc.format = GfxFormat_R16_Uint;
+		m_lightIndexBuffer = Gfx_CreateBuffer(bufferDesc);
+	}
+
+	{
+		GfxBufferDesc bufferDesc;
+		bufferDesc.count  = maxLights;
+		bufferDesc.stride = (u32)sizeof(PackedLightTreeNode);
+		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
+		bufferDesc.format = GfxFormat_Unknown;
+		m_lightTreeBuffer = Gfx_CreateBuffer(bufferDesc);
+	}
+
+	{
+		GfxBufferDesc bufferDesc;
+		bufferDesc.count  = 0;
+		bufferDesc.stride = (u32)sizeof(TiledLightTreeBuilder::LightGridCell);
+		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
+		bufferDesc.format = GfxFormat_Unknown;
+		m_lightTileInfoBuffer = Gfx_CreateBuffer(bufferDesc);
+	}
+}
+
+void TiledLightTreeUploader::upload(
+    GfxContext* ctx, const TiledLightTreeBuilder& builder, TiledLightTreeBuildResult& inOutResult)
+{
+	Timer timer;
+
+	if (!builder.m_gpuLightTreeShallow.empty())
+	{
+		updateBufferFromArray(ctx, m_lightTreeBuffer.get(), builder.m_gpuLightTreeShallow);
+	}
+	else
+	{
+		updateBufferFromArray(ctx, m_lightTreeBuffer.get(), builder.m_gpuLightTree);
+	}
+
+	updateBufferFromArray(ctx, m_lightTileInfoBuffer.get(), builder.m_lightGrid);
+	updateBufferFromArray(ctx, m_lightIndexBuffer.get(), builder.m_gpuLightIndices);
+
+	const double uploadTime = timer.time();
+
+	inOutResult.uploadTime += uploadTime;
+	inOutResult.buildTotalTime += uploadTime;
+}
+
+ClusteredLightUploader::ClusteredLightUploader()
+{
+	{
+		GfxBufferDesc bufferDesc;
+		bufferDesc.count  = 0;
+		bufferDesc.stride = 4;
+		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
+		bufferDesc.format = GfxFormat_R16_Uint;
+		m_lightIndexBuffer = Gfx_CreateBuffer(bufferDesc);
+	}
+
+	{
+		GfxBufferDesc bufferDesc;
+		bufferDesc.count  = 0;
+		bufferDesc.stride = (u32)sizeof(ClusteredLightBuilder::LightGridCell);
+		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
+		bufferDesc.format = GfxFormat_Unknown;
+		m_lightGridBuffer = Gfx_CreateBuffer(bufferDesc);
+	}
+
+	{
+		GfxBufferDesc bufferDesc;
+		bufferDesc.count       = 0;
+		bufferDesc.stride      = 4;
+		bufferDesc.flags       = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
+		bufferDesc.format      = GfxFormat_Unknown;
+		m_lightGridRemapBuffer = Gfx_CreateBuffer(bufferDesc);
+	}
+}
+
+void ClusteredLightUploader::upload(
+    GfxContext* ctx, const ClusteredLightBuilder& builder, ClusteredLightBuildResult& inOutResult)
+{
+	Timer timer;
+
+	updateBufferFromArray(ctx, m_lightGridBuffer.get(), builder.m_lightGrid);
+	if (!builder.m_lightGridRemap.empty())
+	{
+		updateBufferFromArray(ctx, m_lightGridRemapBuffer.get(), builder.m_lightGridRemap);
+	}
+	updateBufferFromArray(ctx, m_lightIndexBuffer.get(), builder.m_gpuLightIndices);
+
+	const double uploadTime = timer.time();
+
+	inOutResult.uploadTime += uploadTime;
+	inOutResult.buildTotalTime += uploadTime;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ClusteredLightBuilder.h"
+#include "TiledLightTreeBuilder.h"
+
+#include <Rush/GfxDevice.h>
+
+// GPU side of TiledLightTreeBuilder.
+// Owns the buffers consumed by the tiled light tree shaders and copies CPU build results into them.
+class TiledLightTreeUploader
+{
+public:
+	TiledLightTreeUploader(u32 maxLights);
+
+	// Submits the output of the most recent TiledLightTreeBuilder::build() call.
+	// Upload time is accumulated into uploadTime and buildTotalTime of the build result.
+	void upload(GfxContext* ctx, const TiledLightTreeBuilder& builder, TiledLightTreeBuildResult& inOutResult);
+
+	GfxOwn<GfxBuffer> m_lightIndexBuffer;
+	GfxOwn<GfxBuffer> m_lightTreeBuffer;
+	GfxOwn<GfxBuffer> m_lightTileInfoBuffer;
+};
+
+// GPU side of ClusteredLightBuilder.
+class ClusteredLightUploader
+{
+public:
+	ClusteredLightUploader();
+
+	// Submits the output of the most recent ClusteredLightBuilder::build() call.
+	// Upload time is accumulated into uploadTime and buildTotalTime of the build result.
+	void upload(GfxContext* ctx, const ClusteredLightBuilder& builder, ClusteredLightBuildResult& inOutResult);
+
+	GfxOwn<GfxBuffer> m_lightGridBuffer;
+	GfxOwn<GfxBuffer> m_lightGridRemapBuffer;
+	GfxOwn<GfxBuffer> m_lightIndexBuffer;
+};
@@ -0,0 +1,338 @@
+#include "LightBvh.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+static constexpr u32 LeafSize = LightSpheresSoA::GroupSize;
+
+inline u32 getLeftChildLightCount(u32 lightCount)
+{
+	// Splits are rounded to the leaf size, so that every leaf starts on a SIMD group boundary
+	return divUp(lightCount / 2, LeafSize) * LeafSize;
+}
+
+enum class BoxFrustumTestResult
+{
+	Outside,
+	Intersecting,
+	Inside,
+};
+
+inline BoxFrustumTestResult testBoxFrustum(const FrustumPlanes& frustum, const Box3& box)
+{
+	const Vec3 center  = box.center();
+	const Vec3 extents = box.dimensions() * 0.5f;
+
+	bool inside = true;
+	for (const Vec4& plane : frustum.planes)
+	{
+		const float d = dot(plane.xyz(), center) + plane.w;
+		const float r = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		if (d < -r)
+		{
+			return BoxFrustumTestResult::Outside;
+		}
+		inside &= d >= r;
+	}
+
+	return inside ? BoxFrustumTestResult::Inside : BoxFrustumTestResult::Intersecting;
+}
+
+inline u32 expandMortonBits(u32 v)
+{
+	// Inserts two zero bits between each of the lower 10 bits
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+inline u32 computeMortonCode(const Vec3& position, const Vec3& boundsMin, const Vec3& scale)
+{
+	const Vec3 p = (position - boundsMin) * scale;
+	const u32  x = (u32)min(max(p.x, 0.0f), 1023.0f);
+	const u32  y = (u32)min(max(p.y, 0.0f), 1023.0f);
+	const u32  z = (u32)min(max(p.z, 0.0f), 1023.0f);
+	return (expandMortonBits(x) << 2) | (expandMortonBits(y) << 1) | expandMortonBits(z);
+}
+
+void LightBvh::build(const AnimatedLightSource* lights, u32 lightCount)
+{
+	m_lightCount = lightCount;
+
+	m_nodes.clear();
+	m_levelOffsets.clear();
+
+	m_lightIndices.resize(lightCount);
+	m_lightSpheres.resize(lightCount);
+
+	if (lightCount == 0)
+	{
+		return;
+	}
+
+	// Lights are ordered along a Morton curve and the tree is built by recursively splitting the sorted range in half.
+	// This is much cheaper than partitioning every level using spatial median splits and produces similar trees.
+
+	Box3 emptyBounds;
+	emptyBounds.expandInit();
+
+	const Box3 positionBounds = parallelReduce(lightCount, 4096, emptyBounds,
+	    [&](u32 begin, u32 end) {
+		    Box3 bounds = emptyBounds;
+		    for (u32 i = begin; i < end; ++i)
+		    {
+			    bounds.expand(lights[i].position);
+		    }
+		    return bounds;
+	    },
+	    [](Box3 a, const Box3& b) {
+		    a.expand(b.m_min);
+		    a.expand(b.m_max);
+		    return a;
+	    });
+
+	const Vec3  boundsSize  = positionBounds.dimensions();
+	const float minExtent   = 1e-6f;
+	const Vec3  mortonScale = Vec3(1023.0f / max(boundsSize.x, minExtent), 1023.0f / max(boundsSize.y, minExtent),
+	    1023.0f / max(boundsSize.z, minExtent));
+
+	std::vector<u32> keys(lightCount);
+	RadixSortBuffers sortBuffers;
+
+	parallelFor<u32>(0, lightCount, [&](u32 i) {
+		keys[i]           = computeMortonCode(lights[i].position, positionBounds.m_min, mortonScale);
+		m_lightIndices[i] = i;
+	});
+
+	// Morton codes have 10 bits per axis
+	parallelRadixSort(keys.data(), m_lightIndices.data(), lightCount, 30, sortBuffers);
+
+	Node root       = {};
+	root.lightCount = lightCount;
+	m_nodes.push_back(root);
+
+	u32 levelBegin = 0;
+	while (levelBegin != (u32)m_nodes.size())
+	{
+		const u32 levelEnd = (u32)m_nodes.size();
+
+		m_levelOffsets.push_back(levelBegin);
+
+		for (u32 nodeIndex = levelBegin; nodeIndex < levelEnd; ++nodeIndex)
+		{
+			const Node node = m_nodes[nodeIndex];
+			if (node.lightCount <= LeafSize)
+			{
+				continue;
+			}
+
+			Node left        = {};
+			left.lightOffset = node.lightOffset;
+			left.lightCount  = getLeftChildLightCount(node.lightCount);
+
+			Node right        = {};
+			right.lightOffset = left.lightOffset + left.lightCount;
+			right.lightCount  = node.lightCount - left.lightCount;
+
+			m_nodes[nodeIndex].firstChild = (u32)m_nodes.size();
+			m_nodes.push_back(left);
+			m_nodes.push_back(right);
+		}
+
+		levelBegin = levelEnd;
+	}
+
+	m_levelOffsets.push_back((u32)m_nodes.size());
+
+	gatherLightSpheres(lights);
+	updateBounds();
+
+	m_builtSurfaceArea = m_surfaceArea;
+}
+
+void LightBvh::refit(const AnimatedLightSource* lights)
+{
+	gatherLightSpheres(lights);
+	updateBounds();
+}
+
+bool LightBvh::update(const AnimatedLightSource* lights, u32 lightCount, float maxSurfaceAreaGrowth)
+{
+	if (m_nodes.empty() || lightCount != m_lightCount)
+	{
+		build(lights, lightCount);
+		return true;
+	}
+
+	refit(lights);
+
+	// Topology that was good for the original light positions degrades as lights move around
+	if (getSurfaceAreaGrowth() > maxSurfaceAreaGrowth)
+	{
+		build(lights, lightCount);
+		return true;
+	}
+
+	return false;
+}
+
+void LightBvh::clear()
+{
+	m_nodes.clear();
+	m_levelOffsets.clear();
+	m_lightCount       = 0;
+	m_surfaceArea      = 0;
+	m_builtSurfaceArea = 0;
+}
+
+void LightBvh::gatherLightSpheres(const AnimatedLightSource* lights)
+{
+	parallelFor<u32>(0, m_lightCount, [&](u32 i) {
+		const LightSource& light = lights[m_lightIndices[i]];
+		m_lightSpheres.x[i]      = light.position.x;
+		m_lightSpheres.y[i]      = light.position.y;
+		m_lightSpheres.z[i]      = light.position.z;
+		m_lightSpheres.r[i]      = light.attenuationEnd;
+	});
+}
+
+inline float getSurfaceArea(const Box3& box)
+{
+	const Vec3 d = box.dimensions();
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+void LightBvh::updateBounds()
+{
+	m_surfaceArea = 0;
+
+	if (m_levelOffsets.empty())
+	{
+		return;
+	}
+
+	// Bottom-up, one level at a time. All nodes of a level only depend on the level below.
+
+	const u32 levelCount = (u32)m_levelOffsets.size() - 1;
+
+	for (u32 level = levelCount; level-- != 0;)
+	{
+		const u32 levelBegin = m_levelOffsets[level];
+		const u32 levelEnd   = m_levelOffsets[level + 1];
+
+		parallelFor<u32>(0, levelEnd - levelBegin, [&](u32 i) {
+			Node& node = m_nodes[levelBegin + i];
+
+			node.bounds.expandInit();
+
+			if (node.firstChild)
+			{
+				for (u32 childIndex = node.firstChild; childIndex < node.firstChild + 2; ++childIndex)
+				{
+					node.bounds.expand(m_nodes[childIndex].bounds.m_min);
+					node.bounds.expand(m_nodes[childIndex].bounds.m_max);
+				}
+			}
+			else
+			{
+				for (u32 j = node.lightOffset; j < node.lightOffset + node.lightCount; ++j)
+				{
+					const Vec3  position = Vec3(m_lightSpheres.x[j], m_lightSpheres.y[j], m_lightSpheres.z[j]);
+					const float radius   = m_lightSpheres.r[j];
+					node.bounds.expand(position - Vec3(radius));
+					node.bounds.expand(position + Vec3(radius));
+				}
+			}
+		});
+	}
+
+	for (const Node& node : m_nodes)
+	{
+		m_surfaceArea += getSurfaceArea(node.bounds);
+	}
+}
+
+u32 LightBvh::cull(const FrustumPlanes& worldSpaceFrustum, AlignedArray<u32>& outIndices) const
+{
+	outIndices.resize(m_lightCount);
+
+	if (m_nodes.empty())
+	{
+		outIndices.m_count = 0;
+		return 0;
+	}
+
+	// Visible lights are marked in a bit set indexed by original light index, which is then expanded in order.
+	// This keeps the output identical to the linear scan without having to sort it.
+
+	std::vector<u32> visibilityMask(divUp(m_lightCount, 32u), 0);
+
+	auto markVisible = [&](u32 leafOrderIndex) {
+		const u32 lightIndex = m_lightIndices[leafOrderIndex];
+		visibilityMask[lightIndex / 32] |= 1u << (lightIndex % 32);
+	};
+
+	const LightingKernels& kernels = getActiveLightingKernels();
+
+	u32 stack[64];
+	u32 stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		const BoxFrustumTestResult testResult = testBoxFrustum(worldSpaceFrustum, node.bounds);
+
+		if (testResult == BoxFrustumTestResult::Outside)
+		{
+			continue;
+		}
+
+		if (testResult == BoxFrustumTestResult::Inside)
+		{
+			for (u32 i = node.lightOffset; i < node.lightOffset + node.lightCount; ++i)
+			{
+				markVisible(i);
+			}
+		}
+		else if (node.firstChild)
+		{
+			RUSH_ASSERT(stackSize + 2 <= RUSH_COUNTOF(stack));
+			stack[stackSize++] = node.firstChild + 1;
+			stack[stackSize++] = node.firstChild;
+		}
+		else
+		{
+			const u32 offset = node.lightOffset;
+
+			u32 mask = kernels.testLightSphereGroup(worldSpaceFrustum, &m_lightSpheres.x[offset],
+			    &m_lightSpheres.y[offset], &m_lightSpheres.z[offset], &m_lightSpheres.r[offset]);
+			mask &= (1u << node.lightCount) - 1;
+
+			while (mask)
+			{
+				markVisible(offset + findFirstSetBit(mask));
+				mask &= mask - 1;
+			}
+		}
+	}
+
+	u32 visibleCount = 0;
+	for (u32 wordIndex = 0; wordIndex < (u32)visibilityMask.size(); ++wordIndex)
+	{
+		u32 mask = visibilityMask[wordIndex];
+		while (mask)
+		{
+			outIndices[visibleCount++] = wordIndex * 32 + findFirstSetBit(mask);
+			mask &= mask - 1;
+		}
+	}
+
+	outIndices.m_count = visibleCount;
+
+	return visibleCount;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "LightingCommon.h"
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+// Bounding volume hierarchy over world space light spheres.
+// Used to frustum cull lights without visiting every light, so that the cost scales with the visible set.
+// Leaves contain LightSpheresSoA::GroupSize lights (the last one may contain fewer), which are tested using the same
+// SIMD kernel as the linear scan.
+class LightBvh
+{
+public:
+	struct Node
+	{
+		Box3 bounds;
+		u32  firstChild; // 0 for leaves, otherwise the left child (right child immediately follows it)
+		u32  lightOffset; // first light in m_lightIndices covered by this subtree
+		u32  lightCount;
+	};
+
+	void build(const AnimatedLightSource* lights, u32 lightCount);
+
+	// Updates node bounds after lights have moved, keeping the tree topology. Light count must not change.
+	void refit(const AnimatedLightSource* lights);
+
+	// Refits the tree, or rebuilds it if the light count changed, the tree was cleared or the total node surface area
+	// grew by more than maxSurfaceAreaGrowth since the last build. Returns true if the tree was rebuilt.
+	bool update(const AnimatedLightSource* lights, u32 lightCount, float maxSurfaceAreaGrowth = 1.5f);
+
+	// Forces the next update() to rebuild the tree
+	void clear();
+
+	// Returns number of visible lights. Output indices refer to the lights used to build the tree and are sorted.
+	u32 cull(const FrustumPlanes& worldSpaceFrustum, AlignedArray<u32>& outIndices) const;
+
+	u32 getLightCount() const { return m_lightCount; }
+
+	// Ratio of current total node surface area to the one right after the last build
+	float getSurfaceAreaGrowth() const { return m_builtSurfaceArea > 0 ? m_surfaceArea / m_builtSurfaceArea : 1.0f; }
+
+	// Nodes are stored breadth-first, tree level N occupies [m_levelOffsets[N], m_levelOffsets[N + 1])
+	std::vector<Node> m_nodes;
+	std::vector<u32>  m_levelOffsets;
+	AlignedArray<u32> m_lightIndices; // light indices in leaf order
+	LightSpheresSoA   m_lightSpheres; // light spheres in leaf order
+
+	u32 m_lightCount = 0;
+
+	float m_surfaceArea      = 0;
+	float m_builtSurfaceArea = 0;
+
+private:
+	void gatherLightSpheres(const AnimatedLightSource* lights);
+	void updateBounds();
+};
@@ -1,7 +1,7 @@
 #include "LightCullApp.h"
 
-#include "DiscreteDistribution.h"
 #include "EmbeddedAssets.h"
+#include "GfxUtils.h"
 #include "Shader.h"
 #include "Utils.h"
 
@@ -185,11 +185,13 @@ LightCullApp::LightCullApp() : BaseApplication()
 #endif
 
 	m_tiledLightTreeBuilder                            = new TiledLightTreeBuilder(MaxLights);
+	m_tiledLightTreeUploader                           = new TiledLightTreeUploader(MaxLights);
 	m_tiledLightTreeBuilderParams.sliceCount           = 16;
 	m_tiledLightTreeBuilderParams.maxSliceDepth        = 60.0f;
 	m_tiledLightTreeBuilderParams.useExponentialSlices = false;
 
 	m_clusteredLightBuilder                            = new ClusteredLightBuilder(MaxLights);
+	m_clusteredLightUploader                           = new ClusteredLightUploader();
 	m_clusteredLightBuilderParams.sliceCount           = 16;
 	m_clusteredLightBuilderParams.maxSliceDepth        = 500.0f;
 	m_clusteredLightBuilderParams.useExponentialSlices = true;
@@ -215,41 +217,29 @@ LightCullApp::~LightCullApp()
 
 	ImGuiImpl_Shutdown();
 
+	delete m_clusteredLightUploader;
 	delete m_clusteredLightBuilder;
+	delete m_tiledLightTreeUploader;
 	delete m_tiledLightTreeBuilder;
 
 	m_windowEvents.setOwner(nullptr);
 }
 
-void LightCullApp::updateLights()
+void LightCullApp::uploadLights(GfxContext* ctx, const std::vector<LightSource>& viewSpaceLights)
 {
-	if (m_viewSpaceLights.size() != m_lightCount)
-	{
-		m_viewSpaceLights.resize(m_lightCount);
-	}
-
-	// TODO: move this to GPU
-	// for (int i = 0; i < m_lightCount; ++i)
-	parallelForEach(m_viewSpaceLights.begin(), m_viewSpaceLights.end(), [&](LightSource& viewSpaceLight) {
-		u64                        i     = &viewSpaceLight - m_viewSpaceLights.data();
-		const AnimatedLightSource& light = m_lights[i];
-		viewSpaceLight                   = light;
-		viewSpaceLight.position          = transformPoint(m_matView, light.position);
-	});
-
 	LightSource dummyLight    = {};
 	const void* lightData     = nullptr;
 	size_t      lightDataSize = 0;
 
-	if (m_viewSpaceLights.empty())
+	if (viewSpaceLights.empty())
 	{
 		lightData     = &dummyLight;
 		lightDataSize = sizeof(dummyLight);
 	}
 	else
 	{
-		lightData     = m_viewSpaceLights.data();
-		lightDataSize = sizeof(LightSource) * m_viewSpaceLights.size();
+		lightData     = viewSpaceLights.data();
+		lightDataSize = sizeof(LightSource) * viewSpaceLights.size();
 	}
 
 	if (!m_lightSourceBuffer.valid())
@@ -261,7 +251,22 @@ void LightCullApp::updateLights()
 		bufferDesc.format = GfxFormat_Unknown;
 		m_lightSourceBuffer = Gfx_CreateBuffer(bufferDesc);
 	}
-	Gfx_UpdateBuffer(m_ctx, m_lightSourceBuffer, lightData, u32(lightDataSize));
+	Gfx_UpdateBuffer(ctx, m_lightSourceBuffer, lightData, u32(lightDataSize));
+}
+
+void LightCullApp::updateLightBvh()
+{
+	const u32 lightCount = min<u32>(m_lightCount, (u32)m_lights.size());
+
+	// Animated lights only require a refit, full rebuild happens when tree quality degrades or lights are regenerated
+	if (m_lightBvhOutdated || m_lightBvh.getLightCount() != lightCount)
+	{
+		Timer timer;
+		m_lightBvh.update(m_lights.data(), lightCount);
+		m_stats.cpuLightBvhUpdate.add(timer.time());
+
+		m_lightBvhOutdated = false;
+	}
 }
 
 void LightCullApp::update()
@@ -452,8 +457,6 @@ void LightCullApp::update()
 	m_matView = m_currentCamera.buildViewMatrix();
 	m_matProj = m_currentCamera.buildProjMatrix();
 
-	updateLights();
-
 	draw();
 }
 
@@ -631,8 +634,48 @@ void LightCullApp::buildLighting(GfxContext* ctx)
 	m_tiledLightTreeBuilderParams.tileSize                = m_tileSize;
 	m_tiledLightTreeBuilderParams.calculateTileLightCount = m_drawTileGrid;
 	m_tiledLightTreeBuilderParams.useTileFrustumCulling   = !!m_useTileFrustumCulling;
+	m_tiledLightTreeBuilderParams.useTileRowSpans         = m_useTileRowSpans;
+	m_tiledLightTreeBuilderParams.maxLightsPerCell        = m_maxLightsPerCell;
 	m_clusteredLightBuilderParams.calculateTileLightCount = m_drawTileGrid;
 	m_clusteredLightBuilderParams.useTileFrustumCulling   = !!m_useTileFrustumCulling;
+	m_clusteredLightBuilderParams.useTileRowSpans         = m_useTileRowSpans;
+	m_clusteredLightBuilderParams.maxLightsPerCell        = m_maxLightsPerCell;
+
+	// Depth ranges only change with the tile grid, since the static gbuffer is the same every frame
+	const TileDepthRange* tileDepthRanges = nullptr;
+	if (m_useStaticGbuffer && m_useTileDepthRanges && !m_staticGbuffer.cpuDepth.empty())
+	{
+		if (m_tileDepthRanges.empty() || m_tileDepthRangesResolution.x != outputResolution.x ||
+		    m_tileDepthRangesResolution.y != outputResolution.y || m_tileDepthRangesTileSize != m_tileSize)
+		{
+			computeTileDepthRanges(m_staticGbuffer.cpuDepth.data(), m_staticGbuffer.cpuDepthWidth,
+			    m_staticGbuffer.cpuDepthHeight, m_currentCamera.getNearPlane(), m_currentCamera.getFarPlane(),
+			    outputResolution, m_tileSize, m_tileDepthRanges);
+			m_tileDepthRangesResolution = outputResolution;
+			m_tileDepthRangesTileSize   = m_tileSize;
+		}
+		tileDepthRanges = m_tileDepthRanges.data();
+	}
+
+	m_tiledLightTreeBuilderParams.tileDepthRanges = tileDepthRanges;
+	m_clusteredLightBuilderParams.tileDepthRanges = tileDepthRanges;
+
+	// Occluders are rendered from the current camera every frame, at 1/8 of the output resolution
+	const OcclusionBuffer* occlusionBuffer = nullptr;
+	if (m_useOcclusionCulling && m_occluderMesh.getTriangleCount())
+	{
+		m_occlusionBuffer.render(m_currentCamera, m_matView, m_occluderMesh, divUp(outputResolution.x, 8u),
+		    divUp(outputResolution.y, 8u));
+		occlusionBuffer = &m_occlusionBuffer;
+	}
+
+	m_tiledLightTreeBuilderParams.occlusionBuffer = occlusionBuffer;
+	m_clusteredLightBuilderParams.occlusionBuffer = occlusionBuffer;
+
+	if (m_useLightBvh)
+	{
+		updateLightBvh();
+	}
 
 	if (m_lightingMode == LightingMode::Hybrid)
 	{
@@ -640,7 +683,11 @@ void LightCullApp::buildLighting(GfxContext* ctx)
 		buildParams.useShallowTree = false;
 
 		m_tiledLightTreeBuildResult =
-		    m_tiledLightTreeBuilder->build(ctx, m_currentCamera, m_viewSpaceLights, buildParams);
+		    m_useLightBvh
+		        ? m_tiledLightTreeBuilder->build(m_currentCamera, m_matView, m_lights, m_lightBvh, buildParams)
+		        : m_tiledLightTreeBuilder->build(m_currentCamera, m_matView, m_lights, m_lightCount, buildParams);
+		m_tiledLightTreeUploader->upload(ctx, *m_tiledLightTreeBuilder, m_tiledLightTreeBuildResult);
+		uploadLights(ctx, m_tiledLightTreeBuilder->m_gpuLights);
 		const auto& stats = m_tiledLightTreeBuildResult;
 
 		m_stats.cpuLightBuildTotal.add(stats.buildTotalTime);
@@ -674,6 +721,8 @@ void LightCullApp::buildLighting(GfxContext* ctx)
 #if USE_GPU_BUILDER
 		if (m_useGpuLightTreeBuilder)
 		{
+			transformLightsToViewSpace(m_matView, m_lights, m_lightCount, m_viewSpaceLights);
+			uploadLights(ctx, m_viewSpaceLights);
 			m_tiledLightTreeBuildResult = m_tiledLightTreeBuilderGPU->build(ctx, m_currentCamera, m_shaderLibrary,
 			    m_lightSourceBuffer.get(), u32(m_viewSpaceLights.size()), buildParams);
 			constants.lightCount        = 0;
@@ -683,7 +732,11 @@ void LightCullApp::buildLighting(GfxContext* ctx)
 #endif
 		{
 			m_tiledLightTreeBuildResult =
-			    m_tiledLightTreeBuilder->build(ctx, m_currentCamera, m_viewSpaceLights, buildParams);
+			    m_useLightBvh
+			        ? m_tiledLightTreeBuilder->build(m_currentCamera, m_matView, m_lights, m_lightBvh, buildParams)
+			        : m_tiledLightTreeBuilder->build(m_currentCamera, m_matView, m_lights, m_lightCount, buildParams);
+			m_tiledLightTreeUploader->upload(ctx, *m_tiledLightTreeBuilder, m_tiledLightTreeBuildResult);
+			uploadLights(ctx, m_tiledLightTreeBuilder->m_gpuLights);
 			constants.lightCount = (u32)m_tiledLightTreeBuilder->m_gpuLights.size();
 			constants.nodeCount  = (u32)m_tiledLightTreeBuilder->m_gpuLightTree.size();
 		}
@@ -714,8 +767,29 @@ void LightCullApp::buildLighting(GfxContext* ctx)
 		buildParams.resolution                         = outputResolution;
 		buildParams.tileSize                           = m_tileSize;
 
+		if (m_useStaticGbuffer && m_useActiveClusterMask && !m_staticGbuffer.cpuDepth.empty())
+		{
+			const CommonLightBuildParams& maskParams = m_activeClusterMaskParams;
+			if (m_activeClusterMask.empty() || maskParams.resolution.x != buildParams.resolution.x ||
+			    maskParams.resolution.y != buildParams.resolution.y || maskParams.tileSize != buildParams.tileSize ||
+			    maskParams.sliceCount != buildParams.sliceCount ||
+			    maskParams.maxSliceDepth != buildParams.maxSliceDepth ||
+			    maskParams.useExponentialSlices != buildParams.useExponentialSlices)
+			{
+				computeActiveClusterMask(m_staticGbuffer.cpuDepth.data(), m_staticGbuffer.cpuDepthWidth,
+				    m_staticGbuffer.cpuDepthHeight, m_currentCamera.getNearPlane(), m_currentCamera.getFarPlane(),
+				    DepthExtentsCalculator(buildParams), outputResolution, m_tileSize, m_activeClusterMask);
+				m_activeClusterMaskParams = buildParams;
+			}
+			buildParams.activeClusterMask = m_activeClusterMask.data();
+		}
+
 		m_clusteredLightBuildResult =
-		    m_clusteredLightBuilder->build(ctx, m_currentCamera, m_viewSpaceLights, buildParams);
+		    m_useLightBvh
+		        ? m_clusteredLightBuilder->build(m_currentCamera, m_matView, m_lights, m_lightBvh, buildParams)
+		        : m_clusteredLightBuilder->build(m_currentCamera, m_matView, m_lights, m_lightCount, buildParams);
+		m_clusteredLightUploader->upload(ctx, *m_clusteredLightBuilder, m_clusteredLightBuildResult);
+		uploadLights(ctx, m_clusteredLightBuilder->m_gpuLights);
 		const auto& stats = m_clusteredLightBuildResult;
 
 		m_stats.cpuLightBuildTotal.add(stats.buildTotalTime);
@@ -725,7 +799,7 @@ void LightCullApp::buildLighting(GfxContext* ctx)
 
 		m_visibleLightCount = stats.visibleLightCount;
 
-		constants.lightCount          = u32(m_viewSpaceLights.size());
+		constants.lightCount          = u32(m_clusteredLightBuilder->m_gpuLights.size());
 		constants.nodeCount           = 0;
 		constants.lightGridSliceCount = m_clusteredLightBuilderParams.sliceCount;
 		constants.lightGridDepthMin   = 0.0f;
@@ -771,9 +845,9 @@ void LightCullApp::applyLighting()
 
 		u32 bufferIndex = 0;
 		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_lightSourceBuffer);
-		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tiledLightTreeBuildResult.lightTreeBuffer);
-		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tiledLightTreeBuildResult.lightTileInfoBuffer);
-		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tiledLightTreeBuildResult.lightIndexBuffer);
+		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tiledLightTreeUploader->m_lightTreeBuffer);
+		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tiledLightTreeUploader->m_lightTileInfoBuffer);
+		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tiledLightTreeUploader->m_lightIndexBuffer);
 
 		Gfx_SetStorageBuffer(m_ctx, bufferIndex++, m_tileStatsBuffer);
 
@@ -804,19 +878,33 @@ void LightCullApp::applyLighting()
 		}
 
 		Gfx_SetStorageBuffer(m_ctx, 0, m_lightSourceBuffer);
-		Gfx_SetStorageBuffer(m_ctx, 1, m_tiledLightTreeBuildResult.lightTreeBuffer);
-		Gfx_SetStorageBuffer(m_ctx, 2, m_tiledLightTreeBuildResult.lightTileInfoBuffer);
-		Gfx_SetStorageBuffer(m_ctx, 3, m_tiledLightTreeBuildResult.lightIndexBuffer);
+		Gfx_SetStorageBuffer(m_ctx, 1, m_tiledLightTreeUploader->m_lightTreeBuffer);
+		Gfx_SetStorageBuffer(m_ctx, 2, m_tiledLightTreeUploader->m_lightTileInfoBuffer);
+		Gfx_SetStorageBuffer(m_ctx, 3, m_tiledLightTreeUploader->m_lightIndexBuffer);
 
 		Gfx_Dispatch(m_ctx, dispatchWidth, dispatchHeight, 1);
 	}
 	else if (m_lightingMode == LightingMode::Clustered)
 	{
-		Gfx_SetTechnique(m_ctx, m_techniqueClusteredShading[debugVisualizationEnabled]);
+		// Light grid is only compacted to active clusters when a mask was used, otherwise the remap buffer is not
+		// uploaded and the grid buffer is bound in its place
+		const bool useLightGridRemap = !m_clusteredLightBuilder->m_lightGridRemap.empty();
+
+		if (useLightGridRemap)
+		{
+			Gfx_SetTechnique(m_ctx, m_techniqueClusteredShadingRemap[debugVisualizationEnabled]);
+		}
+		else
+		{
+			Gfx_SetTechnique(m_ctx, m_techniqueClusteredShading[debugVisualizationEnabled]);
+		}
 
 		Gfx_SetStorageBuffer(m_ctx, 0, m_lightSourceBuffer);
-		Gfx_SetStorageBuffer(m_ctx, 1, m_clusteredLightBuildResult.lightGridBuffer);
-		Gfx_SetStorageBuffer(m_ctx, 2, m_clusteredLightBuildResult.lightIndexBuffer);
+		Gfx_SetStorageBuffer(m_ctx, 1, m_clusteredLightUploader->m_lightGridBuffer);
+		Gfx_SetStorageBuffer(m_ctx, 2, m_clusteredLightUploader->m_lightIndexBuffer);
+		Gfx_SetStorageBuffer(m_ctx, 3,
+		    useLightGridRemap ? m_clusteredLightUploader->m_lightGridRemapBuffer
+		                      : m_clusteredLightUploader->m_lightGridBuffer);
 
 		// TODO: query thread group size from shader or configure it through specialization constants
 		u32 dispatchWidth  = divUp(outputDesc.width, m_threadGroupSizeClusteredShading.x);
@@ -847,8 +935,8 @@ void LightCullApp::generateTileStats()
 	Gfx_SetStorageImage(m_ctx, 0, m_finalFrame);
 
 	Gfx_SetStorageBuffer(m_ctx, 0, m_lightSourceBuffer);
-	Gfx_SetStorageBuffer(m_ctx, 1, m_tiledLightTreeBuildResult.lightTreeBuffer);
-	Gfx_SetStorageBuffer(m_ctx, 2, m_tiledLightTreeBuildResult.lightTileInfoBuffer);
+	Gfx_SetStorageBuffer(m_ctx, 1, m_tiledLightTreeUploader->m_lightTreeBuffer);
+	Gfx_SetStorageBuffer(m_ctx, 2, m_tiledLightTreeUploader->m_lightTileInfoBuffer);
 	Gfx_SetStorageBuffer(m_ctx, 3, m_tileStatsBuffer);
 
 	// TODO: query thread group size from shader or configure it through specialization constants
@@ -1748,18 +1836,42 @@ void LightCullApp::createShaders()
 			bindings.addStorageBuffer("LightBuffer", bindingIndex++);
 			bindings.addStorageBuffer("LightTileInfoBuffer", bindingIndex++);
 			bindings.addTypedRWBuffer("LightIndexBuffer", bindingIndex++);
+			bindings.addStorageBuffer("LightGridRemapBuffer", bindingIndex++);
 
-			SpecializationData specializationData;
-			specializationData.debugVisualizationEnabled = debugVisualizationEnabled;
-			specializationData.threadGroupSizeX          = m_threadGroupSizeClusteredShading.x;
-			specializationData.threadGroupSizeY          = m_threadGroupSizeClusteredShading.y;
+			const GfxSpecializationConstant clusteredSpecializationConstants[] = {
+			    {0, 0, 4},  // enable debug visualization
+			    {1, 4, 4},  // thread group size X
+			    {2, 8, 4},  // thread group size Y
+			    {3, 12, 4}, // use light grid remap
+			};
 
-			GfxTechniqueDesc desc(cs, bindings.desc, m_threadGroupSizeClusteredShading);
-			desc.specializationConstants     = specializationConstants;
-			desc.specializationConstantCount = RUSH_COUNTOF(specializationConstants);
-			desc.specializationData          = &specializationData;
-			desc.specializationDataSize      = sizeof(specializationData);
-			m_techniqueClusteredShading[debugVisualizationEnabled] = Gfx_CreateTechnique(desc);
+			struct ClusteredSpecializationData
+			{
+				u32 debugVisualizationEnabled;
+				u32 threadGroupSizeX;
+				u32 threadGroupSizeY;
+				u32 useLightGridRemap;
+			};
+
+			for (u32 useLightGridRemap = 0; useLightGridRemap < 2; ++useLightGridRemap)
+			{
+				ClusteredSpecializationData specializationData;
+				specializationData.debugVisualizationEnabled = debugVisualizationEnabled;
+				specializationData.threadGroupSizeX          = m_threadGroupSizeClusteredShading.x;
+				specializationData.threadGroupSizeY          = m_threadGroupSizeClusteredShading.y;
+				specializationData.useLightGridRemap         = useLightGridRemap;
+
+				GfxTechniqueDesc desc(cs, bindings.desc, m_threadGroupSizeClusteredShading);
+				desc.specializationConstants     = clusteredSpecializationConstants;
+				desc.specializationConstantCount = RUSH_COUNTOF(clusteredSpecializationConstants);
+				desc.specializationData          = &specializationData;
+				desc.specializationDataSize      = sizeof(specializationData);
+
+				GfxOwn<GfxTechnique>& technique = useLightGridRemap
+				                                      ? m_techniqueClusteredShadingRemap[debugVisualizationEnabled]
+				                                      : m_techniqueClusteredShading[debugVisualizationEnabled];
+				technique = Gfx_CreateTechnique(desc);
+			}
 		}
 	}
 
@@ -1907,6 +2019,8 @@ void LightCullApp::updateGui(float dt)
 			ImGui::Text("Light tree size: %.2f KB", m_tiledLightTreeBuildResult.treeDataSize / 1024.0f);
 			ImGui::Text("Total size: %.2f KB",
 			    (m_tiledLightTreeBuildResult.lightDataSize + m_tiledLightTreeBuildResult.treeDataSize) / 1024.0f);
+			ImGui::Text("Capped cell lights: %d (%.2f%% of importance)", m_tiledLightTreeBuildResult.cappedLightCount,
+			    m_tiledLightTreeBuildResult.cappedImportance * 100.0f);
 		}
 		else if (m_lightingMode == LightingMode::Clustered)
 		{
@@ -1914,6 +2028,8 @@ void LightCullApp::updateGui(float dt)
 			ImGui::Text("Light grid size: %.2f KB", m_clusteredLightBuilder->m_lightGridSize / 1024.0f);
 			ImGui::Text("Total size: %.2f KB",
 			    (m_clusteredLightBuilder->m_lightDataSize + m_clusteredLightBuilder->m_lightGridSize) / 1024.0f);
+			ImGui::Text("Capped cell lights: %d (%.2f%% of importance)", m_clusteredLightBuildResult.cappedLightCount,
+			    m_clusteredLightBuildResult.cappedImportance * 100.0f);
 		}
 
 		const ImVec4 highlightColor(1.0f, 1.0f, 0.5f, 1.0f);
@@ -1923,6 +2039,11 @@ void LightCullApp::updateGui(float dt)
 		ImGui::Text("GPU lighting build time: %.2f ms", m_stats.gpuLightingBuild.getAverage() * 1000.0f);
 		ImGui::Text("GPU total frame time: %.2f ms", m_stats.gpuTotal.getAverage() * 1000.0f);
 
+		if (m_useLightBvh)
+		{
+			ImGui::Text("CPU light BVH update: %.2f ms", m_stats.cpuLightBvhUpdate.getAverage() * 1000.0f);
+		}
+
 		ImGui::Text("CPU light cull: %.2f ms (%.2f%%)", m_stats.cpuLightCull.getAverage() * 1000.0f,
 		    100.0f * m_stats.cpuLightCull.getAverage() / m_stats.cpuLightBuildTotal.getAverage());
 		ImGui::SameLine();
@@ -2030,6 +2151,12 @@ void LightCullApp::updateGui(float dt)
 			    ImGui::SliderInt("Slice count", (int*)&m_clusteredLightBuilderParams.sliceCount, 1, maxSliceCount);
 			settingsChanges |=
 			    ImGui::SliderFloat("Slice max depth", &m_clusteredLightBuilderParams.maxSliceDepth, 1, 500);
+			settingsChanges |=
+			    ImGui::Checkbox("Cluster culling", &m_clusteredLightBuilderParams.useClusterCulling);
+			if (m_useStaticGbuffer)
+			{
+				settingsChanges |= ImGui::Checkbox("Static active clusters", &m_useActiveClusterMask);
+			}
 		}
 
 		if (m_lightingMode == LightingMode::Tree)
@@ -2053,6 +2180,21 @@ void LightCullApp::updateGui(float dt)
 		    RUSH_COUNTOF(tileFrustumCullingStrings));
 		m_useTileFrustumCulling = tileFrustumCullingMode;
 
+		settingsChanges |= ImGui::Checkbox("Use tile row spans", &m_useTileRowSpans);
+		settingsChanges |= ImGui::SliderInt("Max lights per cell", (int*)&m_maxLightsPerCell, 0, 256);
+
+		if (m_useStaticGbuffer)
+		{
+			settingsChanges |= ImGui::Checkbox("Use static depth ranges", &m_useTileDepthRanges);
+		}
+
+		if (m_occluderMesh.getTriangleCount())
+		{
+			settingsChanges |= ImGui::Checkbox("Use occlusion culling", &m_useOcclusionCulling);
+		}
+
+		settingsChanges |= ImGui::Checkbox("Use light BVH", &m_useLightBvh);
+
 		if (settingsChanges)
 		{
 			resetStats();
@@ -2192,67 +2334,11 @@ void LightCullApp::updateGui(float dt)
 	ImGui::End();
 }
 
-inline Vec3 generateDirection(Rand& rng)
-{
-	float u1 = rng.getFloat(0.0f, 1.0f);
-	float u2 = rng.getFloat(0.0f, 1.0f);
-
-	float z   = 1.0f - 2.0f * u1;
-	float r   = sqrtf(max(0.0f, 1.0f - z * z));
-	float phi = TwoPi * u2;
-
-	float x = r * cosf(phi);
-	float y = r * sinf(phi);
-
-	return Vec3(x, y, z);
-}
-
 void LightCullApp::generateLights(u32 count, float minIntensity, float maxIntensity)
 {
-	Rand m_rng = Rand(m_randomSeed);
-
-	m_lights.clear();
-
-	float minLightRadius = FLT_MAX;
-	float maxLightRadius = -FLT_MAX;
-	float avgLightRadius = 0;
-
 	const u32 lightCount = min<u32>(count, MaxLights);
 
-	for (u32 i = 0; i < lightCount; ++i)
-	{
-		AnimatedLightSource light = {};
-
-		light.position.x = m_rng.getFloat(m_lightAnimationBounds.m_min.x, m_lightAnimationBounds.m_max.x);
-		light.position.y = m_rng.getFloat(m_lightAnimationBounds.m_min.y, m_lightAnimationBounds.m_max.y);
-		light.position.z = m_rng.getFloat(m_lightAnimationBounds.m_min.z, m_lightAnimationBounds.m_max.z);
-
-		light.originalPosition = light.position;
-
-		light.movementDirection   = generateDirection(m_rng);
-		light.movementDirection.x = abs(light.movementDirection.x);
-		light.movementDirection.y = abs(light.movementDirection.y);
-		light.movementDirection.z = abs(light.movementDirection.z);
-
-		light.intensity.x = m_rng.getFloat(minIntensity, maxIntensity);
-		light.intensity.y = m_rng.getFloat(minIntensity, maxIntensity);
-		light.intensity.z = m_rng.getFloat(minIntensity, maxIntensity);
-
-		const float intensity                     = dot(light.intensity, Vec3(1.0f / 3.0f));
-		const float attenuationIntensityThreshold = 0.025f;
-		light.attenuationEnd                      = intensity / sqrtf(attenuationIntensityThreshold);
-
-		minLightRadius = min(minLightRadius, light.attenuationEnd);
-		maxLightRadius = max(maxLightRadius, light.attenuationEnd);
-		avgLightRadius += light.attenuationEnd;
-
-		m_lights.push_back(light);
-	}
-
-	avgLightRadius /= lightCount;
-
-	Log::message("Light radius range: %f .. %f", minLightRadius, maxLightRadius);
-	Log::message("Average light radius: %f", avgLightRadius);
+	::generateLights(m_lights, lightCount, m_lightAnimationBounds, minIntensity, maxIntensity, m_randomSeed);
 
 	animateLights(m_lightAnimationTime, 10000); // 10k is to preserve the behavior before bugfix
 
@@ -2263,151 +2349,27 @@ void LightCullApp::generateLights(u32 count, float minIntensity, float maxIntens
 	m_pendingLightParams = m_currentLightParams;
 }
 
-inline Vec3 computeTriangleNormal(Vec3 a, Vec3 b, Vec3 c) { return normalize(cross(c - a, c - b)); }
-
-inline float computeTriangleArea(Vec3 a, Vec3 b, Vec3 c) { return length(cross(c - a, c - b)) * 0.5f; }
-
 void LightCullApp::generateLightsOnGeometry(u32 count, float minIntensity, float maxIntensity)
 {
-	Rand m_rng = Rand(m_randomSeed);
-
-	m_lights.clear();
-
-	float minLightRadius = FLT_MAX;
-	float maxLightRadius = -FLT_MAX;
-	float avgLightRadius = 0;
-
-	std::vector<float> triangleAreas;
-	std::vector<Vec3>  triangleNormals;
-
-	u32 triangleCount = (u32)m_model->indices.size() / 3;
-
-	if (triangleCount == 0)
-		return;
-
-	triangleAreas.resize(triangleCount);
-	triangleNormals.resize(triangleCount);
-
-	struct Triangle
-	{
-		Vec3 a, b, c;
-	};
-
-	auto getTriangle = [&](u32 triangleIndex) {
-		Triangle result;
-
-		u32 indices[3] = {m_model->indices[triangleIndex * 3 + 0], m_model->indices[triangleIndex * 3 + 1],
-		    m_model->indices[triangleIndex * 3 + 2]};
-
-		result.a = m_model->vertices[indices[0]].position;
-		result.b = m_model->vertices[indices[1]].position;
-		result.c = m_model->vertices[indices[2]].position;
-
-		return result;
-	};
-
-	parallelFor<u32>(0, triangleCount, [&](u32 triangleIndex) {
-		Triangle tri                   = getTriangle(triangleIndex);
-		float    area                  = computeTriangleArea(tri.a, tri.b, tri.c);
-		Vec3     normal                = computeTriangleNormal(tri.a, tri.b, tri.c);
-		triangleAreas[triangleIndex]   = area;
-		triangleNormals[triangleIndex] = normal;
-	});
-
-	float triangleAreaSum = 0.0;
-	for (u32 i = 0; i < triangleCount; ++i)
-	{
-		triangleAreaSum += triangleAreas[i];
-	}
-
-	DiscreteDistribution<float> distribution(triangleAreas.data(), triangleCount, triangleAreaSum);
-
-	m_lights.reserve(count);
-
 	const u32 lightCount = min<u32>(count, MaxLights);
 
-	for (u32 i = 0; i < lightCount; ++i)
-	{
-		u32 triangleIndex = (u32)distribution(m_rng.rand(), m_rng.getFloat(0.0f, 1.0f));
-
-		if (triangleAreas[triangleIndex] == 0.0f)
-			continue;
-
-		Triangle tri = getTriangle(triangleIndex);
-
-		AnimatedLightSource light = {};
-
-		light.originalPosition  = light.position;
-		light.movementDirection = Vec3(0.0);
+	::generateLightsOnGeometry(m_lights, *m_model, lightCount, minIntensity, maxIntensity, m_randomSeed);
 
-		light.intensity.x = m_rng.getFloat(minIntensity, maxIntensity);
-		light.intensity.y = m_rng.getFloat(minIntensity, maxIntensity);
-		light.intensity.z = m_rng.getFloat(minIntensity, maxIntensity);
-
-		const float intensity                     = dot(light.intensity, Vec3(1.0f / 3.0f));
-		const float attenuationIntensityThreshold = 0.025f;
-		light.attenuationEnd                      = intensity / sqrtf(attenuationIntensityThreshold);
-
-		float u, v;
-		for (;;)
-		{
-			u = m_rng.getFloat(0.0f, 1.0f);
-			v = m_rng.getFloat(0.0f, 1.0f);
-			if (u + v <= 1)
-				break;
-		}
-		float w        = 1.0f - u - v;
-		light.position = tri.a * u + tri.b * v + tri.c * w;
-		light.position += triangleNormals[triangleIndex] * light.attenuationEnd * 0.25f;
-
-		minLightRadius = min(minLightRadius, light.attenuationEnd);
-		maxLightRadius = max(maxLightRadius, light.attenuationEnd);
-		avgLightRadius += light.attenuationEnd;
-
-		m_lights.push_back(light);
-	}
+	m_lightBvh.clear();
+	m_lightBvhOutdated = true;
 
 	m_currentLightParams.count        = count;
 	m_currentLightParams.minIntensity = minIntensity;
 	m_currentLightParams.maxIntensity = maxIntensity;
 
 	m_pendingLightParams = m_currentLightParams;
-
-	avgLightRadius /= lightCount;
-
-	Log::message("Light radius range: %f .. %f", minLightRadius, maxLightRadius);
-	Log::message("Average light radius: %f", avgLightRadius);
 }
 
-inline float frac(float value) { return value - floorf(value); }
-
 void LightCullApp::animateLights(float elapsedTime, u32 lightCount)
 {
-	Vec3 worldSize   = m_lightAnimationBounds.dimensions();
-	Vec3 worldOffset = m_lightAnimationBounds.m_min;
-
-	Vec3 animationSpeed = Vec3(10.0f, 0.01f, 10.0f);
-
-	for (u32 i = 0; i < lightCount; ++i)
-	{
-		auto& light = m_lights[i];
-
-		if (light.movementDirection == Vec3(0.0f))
-			continue;
-
-		Vec3 o = (light.originalPosition - worldOffset) / worldSize;
-		Vec3 p = o + (light.movementDirection * (elapsedTime * animationSpeed)) / worldSize;
-
-		int mx = (int)p.x % 2;
-		int my = (int)p.y % 2;
-		int mz = (int)p.z % 2;
+	::animateLights(m_lights, m_lightAnimationBounds, elapsedTime, lightCount);
 
-		p.x = mx ? frac(p.x) : 1.0f - frac(p.x);
-		p.y = my ? frac(p.y) : 1.0f - frac(p.y);
-		p.z = mz ? frac(p.z) : 1.0f - frac(p.z);
-
-		light.position = p * worldSize + worldOffset;
-	}
+	m_lightBvhOutdated = true;
 }
 
 bool LightCullApp::loadModel(const char* filename)
@@ -2478,6 +2440,8 @@ bool LightCullApp::loadModel(const char* filename)
 	m_vertexCount = (u32)model.vertices.size();
 	m_indexCount  = (u32)model.indices.size();
 
+	m_occluderMesh.build(model);
+
 	GfxBufferDesc vbDesc(GfxBufferFlags::Vertex, m_vertexCount, sizeof(ModelVertex));
 	m_vertexBuffer = Gfx_CreateBuffer(vbDesc, model.vertices.data());
 
@@ -2764,7 +2728,9 @@ void LightCullApp::processCommand(const CmdLoadStaticScene& cmd)
 		m_lights.push_back(light);
 	}
 
-	m_lightCount = (int)m_lights.size();
+	m_lightCount       = (int)m_lights.size();
+	m_lightBvhOutdated = true;
+	m_lightBvh.clear();
 
 	// Compute camera parameters based on provided view & projection matrices
 	{
@@ -2801,6 +2767,19 @@ void LightCullApp::processCommand(const CmdLoadStaticScene& cmd)
 		m_staticGbuffer.albedo     = loadDDS(cmd.albedo.c_str());
 		m_staticGbuffer.specularRM = loadDDS(cmd.specularRM.c_str());
 
+		if (loadDDSDepth(cmd.depth.c_str(), m_staticGbuffer.cpuDepth, m_staticGbuffer.cpuDepthWidth,
+		        m_staticGbuffer.cpuDepthHeight))
+		{
+			// Same conversion as GbufferTranscode.frag
+			for (float& depth : m_staticGbuffer.cpuDepth)
+			{
+				depth = 1.0f - depth;
+			}
+		}
+
+		m_tileDepthRanges.clear();
+		m_activeClusterMask.clear();
+
 		m_useStaticGbuffer = true;
 	}
 }
@@ -3,8 +3,11 @@
 #include "BaseApplication.h"
 #include "ClusteredLightBuilder.h"
 #include "Fiber.h"
+#include "LightBuildUpload.h"
+#include "LightScene.h"
 #include "LightingCommon.h"
 #include "Model.h"
+#include "OcclusionCulling.h"
 #include "Scripting.h"
 #include "Shaders/ShaderDefines.h"
 #include "TiledLightTreeBuilder.h"
@@ -41,12 +44,6 @@ enum class ViewMode
 	count
 };
 
-struct CameraKeyFrame
-{
-	Vec3 position;
-	Vec3 target;
-};
-
 struct BenchmarkFrame
 {
 	u32   frameId;
@@ -120,7 +117,8 @@ public:
 	~LightCullApp();
 
 	void update();
-	void updateLights();
+	void uploadLights(GfxContext* ctx, const std::vector<LightSource>& viewSpaceLights);
+	void updateLightBvh();
 
 private:
 	enum Timestamp
@@ -182,6 +180,7 @@ private:
 		StatsAccumulator<double, 60> gpuLightingBuild;
 		StatsAccumulator<double, 60> gpuTotal;
 
+		StatsAccumulator<double, 60> cpuLightBvhUpdate;
 		StatsAccumulator<double, 60> cpuLightCull;
 		StatsAccumulator<double, 60> cpuLightAssign;
 		StatsAccumulator<double, 60> cpuLightBuildTree;
@@ -217,6 +216,7 @@ private:
 	GfxOwn<GfxTechnique> m_techniqueTiledLightTreeShadingMasked[2];
 	GfxOwn<GfxTechnique> m_techniqueHybridTiledLightTreeShading[2];
 	GfxOwn<GfxTechnique> m_techniqueClusteredShading[2];
+	GfxOwn<GfxTechnique> m_techniqueClusteredShadingRemap[2]; // looks up clusters through the light grid remap
 	GfxOwn<GfxTechnique> m_techniqueTileStatsDisplay;
 	GfxOwn<GfxTechnique> m_techniqueTileStatsGenerate;
 	GfxOwn<GfxTechnique> m_techniqueTileStatsReduce;
@@ -255,6 +255,11 @@ private:
 		GfxOwn<GfxTexture> albedo;
 		GfxOwn<GfxTexture> normals;
 		GfxOwn<GfxTexture> specularRM;
+
+		// Depth as written by the transcode pass, in [0, 1] from near to far plane, for CPU light culling
+		std::vector<float> cpuDepth;
+		u32                cpuDepthWidth  = 0;
+		u32                cpuDepthHeight = 0;
 	};
 
 	StaticGbuffer m_staticGbuffer;
@@ -329,11 +334,15 @@ private:
 	};
 	int m_lightCount = 10000;
 
-	std::vector<LightSource> m_viewSpaceLights;
-	GfxOwn<GfxBuffer>        m_lightSourceBuffer; // contains data from m_viewSpaceLights
+	std::vector<LightSource> m_viewSpaceLights; // only used by GPU light tree builder
+	GfxOwn<GfxBuffer>        m_lightSourceBuffer; // view space lights referenced by the current light grid
 
 	std::vector<AnimatedLightSource> m_lights;
 
+	LightBvh m_lightBvh;
+	bool     m_useLightBvh      = true;
+	bool     m_lightBvhOutdated = true; // set whenever m_lights move, m_lightBvh is also cleared if they are replaced
+
 	static constexpr u32 m_randomSeed = 2;
 	Rand                 m_rng        = Rand(m_randomSeed);
 
@@ -371,8 +380,24 @@ private:
 	LightingMode m_lightingMode          = LightingMode::Tree;
 	bool         m_useAsyncCompute       = false;
 	u32          m_useTileFrustumCulling = 2;
+	bool         m_useTileRowSpans       = true;
+	bool         m_useTileDepthRanges    = true; // cull lights against static gbuffer depth, if it is loaded
+	u32          m_maxLightsPerCell      = 0;    // keep only the most important lights in each cell, no limit if 0
+
+	std::vector<TileDepthRange> m_tileDepthRanges;
+	Tuple2u                     m_tileDepthRangesResolution = Tuple2u{0, 0};
+	u32                         m_tileDepthRangesTileSize   = 0;
+
+	bool                   m_useActiveClusterMask = false; // only fill clusters that contain static gbuffer samples
+	std::vector<u32>       m_activeClusterMask;
+	CommonLightBuildParams m_activeClusterMaskParams; // grid that m_activeClusterMask was computed for
+
+	bool            m_useOcclusionCulling = false; // cull lights hidden behind model geometry, if it is loaded
+	OccluderMesh    m_occluderMesh;
+	OcclusionBuffer m_occlusionBuffer;
 
-	TiledLightTreeBuilder* m_tiledLightTreeBuilder = nullptr;
+	TiledLightTreeBuilder*  m_tiledLightTreeBuilder  = nullptr;
+	TiledLightTreeUploader* m_tiledLightTreeUploader = nullptr;
 
 #if USE_GPU_BUILDER
 	TiledLightTreeBuilderGPU* m_tiledLightTreeBuilderGPU = nullptr;
@@ -384,7 +409,8 @@ private:
 	TiledLightTreeBuildParams m_tiledLightTreeBuilderParams;
 	TiledLightTreeBuildResult m_tiledLightTreeBuildResult;
 
-	ClusteredLightBuilder*             m_clusteredLightBuilder = nullptr;
+	ClusteredLightBuilder*             m_clusteredLightBuilder  = nullptr;
+	ClusteredLightUploader*            m_clusteredLightUploader = nullptr;
 	ClusteredLightBuilder::BuildParams m_clusteredLightBuilderParams;
 	ClusteredLightBuildResult          m_clusteredLightBuildResult;
 
@@ -0,0 +1,1449 @@
+// Headless benchmark for the CPU light culling and light data structure builders.
+// Runs TiledLightTreeBuilder and ClusteredLightBuilder over a set of camera frames and reports per-phase timings.
+
+#include "ClusteredLightBuilder.h"
+#include "LightBvh.h"
+#include "LightScene.h"
+#include "LightingCommon.h"
+#include "Model.h"
+#include "OcclusionCulling.h"
+#include "TiledLightTreeBuilder.h"
+#include "Utils.h"
+
+#include <Rush/MathTypes.h>
+#include <Rush/UtilCamera.h>
+#include <Rush/UtilFile.h>
+#include <Rush/UtilLog.h>
+#include <Rush/UtilRandom.h>
+#include <Rush/UtilTimer.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+enum
+{
+	MaxLights = 65536
+};
+
+enum class CullMethod
+{
+	ViewSpace,  // transform all lights to view space, then cull them with a linear scan
+	WorldSpace, // cull world space lights with a linear scan, transform only visible ones
+	Bvh,        // walk a world space light BVH, transform only visible ones
+
+	count
+};
+
+const char* toString(CullMethod method)
+{
+	switch (method)
+	{
+	default: return "unknown";
+	case CullMethod::ViewSpace: return "view";
+	case CullMethod::WorldSpace: return "world";
+	case CullMethod::Bvh: return "bvh";
+	}
+}
+
+struct BenchConfig
+{
+	std::string modelName;
+	std::string replayName;
+	std::string cameraName;
+	std::string csvName;
+
+	u32 lightCount       = 10000;
+	u32 iterations       = 10;
+	u32 warmupIterations = 2;
+	u32 orbitFrameCount  = 64;
+	u32 width            = 1920;
+	u32 height           = 1080;
+	u32 tileSize         = 48;
+	u32 randomSeed       = 2;
+	u32 maxLightsPerCell = 0;
+
+	float minLightIntensity = 0.05f;
+	float maxLightIntensity = 0.75f;
+
+	bool lightsOnGeometry       = false;
+	bool animateLights          = false;
+	bool useTileFrustumCulling  = true;
+	bool useTileRowSpans        = true;
+	bool useClusterCulling      = true;
+	bool useShallowTree         = false;
+	bool useClippedLightExtents = false;
+	bool useOcclusionCulling    = false;
+
+	// Overrides slice distribution of all modes when set
+	bool forceLinearSlices      = false;
+	bool forceExponentialSlices = false;
+
+	bool runCullMethod[(int)CullMethod::count] = {true, true, true};
+
+	SimdIsa simdIsa = getBestSimdIsa();
+
+	bool runTree      = true;
+	bool runHybrid    = true;
+	bool runClustered = true;
+
+	bool validate      = false;
+	bool sortBenchmark = false;
+};
+
+struct PhaseStats
+{
+	PhaseStats(const char* phaseName) : name(phaseName) {}
+
+	const char*         name;
+	std::vector<double> samples;
+};
+
+struct ModeResult
+{
+	PhaseStats lightBvh    = {"lightBvh"};
+	PhaseStats lightCull   = {"lightCull"};
+	PhaseStats lightSort   = {"lightSort"};
+	PhaseStats lightAssign = {"lightAssign"};
+	PhaseStats buildTree   = {"buildTree"};
+	PhaseStats buildTotal  = {"total"};
+
+	u64    visibleLightSum      = 0;
+	u64    dataSizeSum          = 0;
+	u64    cappedLightSum       = 0;
+	double cappedImportanceSum  = 0;
+	u32    lightBvhRebuildCount = 0;
+};
+
+void printUsage()
+{
+	printf("Usage: LightCullBench [options]\n"
+	       "  --model <file>          Load scene geometry (.model) used for light placement\n"
+	       "  --replay <file>         Camera path recorded by LightCull (replay.bin)\n"
+	       "  --camera <file>         Single camera saved by LightCull (camera.bin)\n"
+	       "  --frames <n>            Number of generated orbit frames when no camera is given (default 64)\n"
+	       "  --lights <n>            Number of lights (default 10000, max 65536)\n"
+	       "  --geometry              Place lights on model geometry instead of inside its bounds\n"
+	       "  --max-intensity <f>     Maximum light intensity (default 0.75)\n"
+	       "  --animate               Animate lights between camera frames\n"
+	       "  --cull <name>           Light culling method: view, world, bvh or all (default all)\n"
+	       "                            view:  transform all lights to view space, then scan them\n"
+	       "                            world: scan world space lights, transform visible ones\n"
+	       "                            bvh:   walk a world space light BVH, transform visible ones\n"
+	       "  --iterations <n>        Measured passes over all camera frames (default 10)\n"
+	       "  --warmup <n>            Discarded passes before measurement (default 2)\n"
+	       "  --mode <name>           tree, hybrid, clustered or all (default all)\n"
+	       "  --resolution <w> <h>    Output resolution (default 1920 1080)\n"
+	       "  --tile-size <n>         Tile size in pixels (default 48)\n"
+	       "  --max-cell-lights <n>   Keep only the n most important lights in each cell (default 0, no limit)\n"
+	       "  --box-bounds            Bin lights into all tiles of their screen space boxes instead of tile row spans\n"
+	       "  --no-frustum-culling    Skip per-tile frustum tests and assign lights to all tiles of their bounds\n"
+	       "  --no-cluster-culling    Assign clustered lights to all slices of a tile that overlap their depth range\n"
+	       "  --slices <name>         Depth slice distribution of all modes: linear or exponential\n"
+	       "                            (default linear for tree and hybrid, exponential for clustered)\n"
+	       "  --shallow-tree          Build 8-ary light trees in tree mode\n"
+	       "  --clipped-light-extents Use light extents clipped to the cell for the hybrid light tree heuristic\n"
+	       "  --occlusion             Cull lights hidden behind model geometry rasterized into a CPU depth buffer\n"
+	       "                            at 1/8 of the output resolution (requires --model)\n"
+	       "  --simd <name>           Culling kernel instruction set: scalar, sse4.1, avx2 or avx512\n"
+	       "                            (default is the widest one supported by the CPU)\n"
+	       "  --csv <file>            Write all measured samples to a CSV file\n"
+	       "  --validate              Compare light grid cells against a brute force assignment and SIMD culling,\n"
+	       "                            light extents and point transform kernels against the scalar ones and exit\n"
+	       "  --sort-benchmark        Compare parallel radix sort of float keys against std::sort and a depth\n"
+	       "                            bucket sort at 1K to 1M elements and exit\n");
+}
+
+bool parseCommandLine(int argc, char** argv, BenchConfig& config)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg     = argv[i];
+		const bool  hasNext = i + 1 < argc;
+
+		if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+		{
+			return false;
+		}
+		else if (!strcmp(arg, "--model") && hasNext)
+		{
+			config.modelName = argv[++i];
+		}
+		else if (!strcmp(arg, "--replay") && hasNext)
+		{
+			config.replayName = argv[++i];
+		}
+		else if (!strcmp(arg, "--camera") && hasNext)
+		{
+			config.cameraName = argv[++i];
+		}
+		else if (!strcmp(arg, "--csv") && hasNext)
+		{
+			config.csvName = argv[++i];
+		}
+		else if (!strcmp(arg, "--frames") && hasNext)
+		{
+			config.orbitFrameCount = max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(arg, "--lights") && hasNext)
+		{
+			config.lightCount = min<u32>(max(0, atoi(argv[++i])), MaxLights);
+		}
+		else if (!strcmp(arg, "--geometry"))
+		{
+			config.lightsOnGeometry = true;
+		}
+		else if (!strcmp(arg, "--max-intensity") && hasNext)
+		{
+			config.maxLightIntensity = (float)atof(argv[++i]);
+		}
+		else if (!strcmp(arg, "--animate"))
+		{
+			config.animateLights = true;
+		}
+		else if (!strcmp(arg, "--cull") && hasNext)
+		{
+			const char* method = argv[++i];
+			const bool  all    = !strcmp(method, "all");
+			bool        valid  = all;
+			for (int methodIndex = 0; methodIndex < (int)CullMethod::count; ++methodIndex)
+			{
+				const bool match                   = !strcmp(method, toString(CullMethod(methodIndex)));
+				config.runCullMethod[methodIndex] = all || match;
+				valid |= match;
+			}
+			if (!valid)
+			{
+				Log::error("Unknown culling method '%s'", method);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "--iterations") && hasNext)
+		{
+			config.iterations = max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(arg, "--warmup") && hasNext)
+		{
+			config.warmupIterations = max(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(arg, "--mode") && hasNext)
+		{
+			const char* mode    = argv[++i];
+			const bool  all     = !strcmp(mode, "all");
+			config.runTree      = all || !strcmp(mode, "tree");
+			config.runHybrid    = all || !strcmp(mode, "hybrid");
+			config.runClustered = all || !strcmp(mode, "clustered");
+			if (!config.runTree && !config.runHybrid && !config.runClustered)
+			{
+				Log::error("Unknown mode '%s'", mode);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "--resolution") && i + 2 < argc)
+		{
+			config.width  = max(1, atoi(argv[++i]));
+			config.height = max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(arg, "--tile-size") && hasNext)
+		{
+			config.tileSize = max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(arg, "--max-cell-lights") && hasNext)
+		{
+			config.maxLightsPerCell = max(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(arg, "--box-bounds"))
+		{
+			config.useTileRowSpans = false;
+		}
+		else if (!strcmp(arg, "--no-frustum-culling"))
+		{
+			config.useTileFrustumCulling = false;
+		}
+		else if (!strcmp(arg, "--no-cluster-culling"))
+		{
+			config.useClusterCulling = false;
+		}
+		else if (!strcmp(arg, "--slices") && hasNext)
+		{
+			const char* distribution      = argv[++i];
+			config.forceLinearSlices      = !strcmp(distribution, "linear");
+			config.forceExponentialSlices = !strcmp(distribution, "exponential");
+			if (!config.forceLinearSlices && !config.forceExponentialSlices)
+			{
+				Log::error("Unknown slice distribution '%s'", distribution);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "--shallow-tree"))
+		{
+			config.useShallowTree = true;
+		}
+		else if (!strcmp(arg, "--clipped-light-extents"))
+		{
+			config.useClippedLightExtents = true;
+		}
+		else if (!strcmp(arg, "--occlusion"))
+		{
+			config.useOcclusionCulling = true;
+		}
+		else if (!strcmp(arg, "--simd") && hasNext)
+		{
+			static const char* simdIsaNames[] = {"scalar", "sse4.1", "avx2", "avx512"};
+			static_assert(RUSH_COUNTOF(simdIsaNames) == (size_t)SimdIsa::count, "Missing instruction set names");
+
+			const char* name  = argv[++i];
+			u32         index = 0;
+			while (index < (u32)SimdIsa::count && strcmp(name, simdIsaNames[index]))
+			{
+				++index;
+			}
+
+			if (index == (u32)SimdIsa::count)
+			{
+				Log::error("Unknown instruction set '%s'", name);
+				return false;
+			}
+
+			if (!isSimdIsaSupported((SimdIsa)index))
+			{
+				Log::error("Instruction set '%s' is not supported on this machine", name);
+				return false;
+			}
+
+			config.simdIsa = (SimdIsa)index;
+		}
+		else if (!strcmp(arg, "--validate"))
+		{
+			config.validate = true;
+		}
+		else if (!strcmp(arg, "--sort-benchmark"))
+		{
+			config.sortBenchmark = true;
+		}
+		else
+		{
+			Log::error("Unknown or incomplete argument '%s'", arg);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Orbit around the scene at roughly eye level, looking at the center of the bounding box
+std::vector<CameraKeyFrame> generateOrbitCameraFrames(const Box3& bounds, u32 frameCount)
+{
+	std::vector<CameraKeyFrame> result(frameCount);
+
+	const Vec3  center = bounds.center();
+	const Vec3  dims   = bounds.dimensions();
+	const float radius = max(dims.x, dims.z) * 0.5f;
+
+	for (u32 i = 0; i < frameCount; ++i)
+	{
+		const float angle = TwoPi * float(i) / float(frameCount);
+
+		CameraKeyFrame& frame = result[i];
+		frame.position = center + Vec3(cosf(angle) * radius, dims.y * 0.25f, sinf(angle) * radius);
+		frame.target   = center;
+	}
+
+	return result;
+}
+
+double getPercentile(const std::vector<double>& sortedSamples, double percentile)
+{
+	if (sortedSamples.empty())
+	{
+		return 0.0;
+	}
+
+	// nearest-rank method
+	size_t rank = (size_t)ceil(percentile / 100.0 * double(sortedSamples.size()));
+	rank        = min<size_t>(max<size_t>(rank, 1), sortedSamples.size());
+	return sortedSamples[rank - 1];
+}
+
+void printPhaseStats(const PhaseStats& phase)
+{
+	std::vector<double> sorted = phase.samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	printf("  %-12s %9.3f %9.3f %9.3f %9.3f\n", phase.name, getPercentile(sorted, 0.0) * 1000.0,
+	    getPercentile(sorted, 50.0) * 1000.0, getPercentile(sorted, 95.0) * 1000.0,
+	    getPercentile(sorted, 99.0) * 1000.0);
+}
+
+void printModeResult(const char* modeName, const ModeResult& result)
+{
+	const size_t sampleCount = max<size_t>(1, result.buildTotal.samples.size());
+
+	printf("\n%s (%d samples, avg. visible lights: %.1f, avg. data size: %.1f KB)\n", modeName,
+	    (int)result.buildTotal.samples.size(), double(result.visibleLightSum) / sampleCount,
+	    double(result.dataSizeSum) / sampleCount / 1024.0);
+	printf("  %-12s %9s %9s %9s %9s\n", "phase (ms)", "min", "median", "p95", "p99");
+
+	printPhaseStats(result.lightBvh);
+	printPhaseStats(result.lightCull);
+	printPhaseStats(result.lightSort);
+	printPhaseStats(result.lightAssign);
+	printPhaseStats(result.buildTree);
+	printPhaseStats(result.buildTotal);
+
+	if (result.cappedLightSum)
+	{
+		printf("  avg. capped cell lights: %.1f (%.2f%% of importance)\n", double(result.cappedLightSum) / sampleCount,
+		    result.cappedImportanceSum / sampleCount * 100.0);
+	}
+
+	if (result.lightBvhRebuildCount)
+	{
+		printf("  light BVH rebuilds: %d\n", (int)result.lightBvhRebuildCount);
+	}
+}
+
+void writeModeResultCSV(FILE* file, const char* modeName, const ModeResult& result)
+{
+	for (size_t i = 0; i < result.buildTotal.samples.size(); ++i)
+	{
+		fprintf(file, "%s, %d, %f, %f, %f, %f, %f, %f\n", modeName, (int)i, result.lightBvh.samples[i] * 1000.0,
+		    result.lightCull.samples[i] * 1000.0, result.lightSort.samples[i] * 1000.0,
+		    result.lightAssign.samples[i] * 1000.0, result.buildTree.samples[i] * 1000.0,
+		    result.buildTotal.samples[i] * 1000.0);
+	}
+}
+
+class Benchmark
+{
+public:
+	Benchmark(const BenchConfig& config) : m_config(config) {}
+
+	bool setupScene();
+	void run();
+	bool validate();
+
+private:
+	template <typename F> void forEachFrame(F runFrame);
+
+	void runTiledLightTree(LightingMode mode, ModeResult& outResult);
+	void runClustered(ModeResult& outResult);
+
+	void setupFrame(u32 frameIndex);
+
+	bool validateKernels();
+	bool validateLightGrid();
+
+	const BenchConfig& m_config;
+
+	Model m_model;
+	bool  m_modelLoaded = false;
+	Box3  m_lightAnimationBounds;
+
+	OccluderMesh    m_occluderMesh;
+	OcclusionBuffer m_occlusionBuffer;
+
+	std::vector<AnimatedLightSource> m_lights;
+	std::vector<LightSource>         m_viewSpaceLights;
+	LightBvh                         m_lightBvh;
+	std::vector<CameraKeyFrame>      m_cameraFrames;
+
+	Camera     m_camera;
+	Mat4       m_matView             = Mat4::identity();
+	CullMethod m_cullMethod          = CullMethod::WorldSpace;
+	double     m_viewTransformTime   = 0;
+	double     m_lightBvhUpdateTime  = 0;
+	double     m_occlusionRenderTime = 0;
+	bool       m_lightBvhRebuilt     = false;
+	bool       m_useFixedCamera      = false;
+
+	TiledLightTreeBuildParams          m_tiledLightTreeBuilderParams;
+	ClusteredLightBuilder::BuildParams m_clusteredLightBuilderParams;
+};
+
+bool Benchmark::setupScene()
+{
+	// Same defaults as LightCullApp
+	m_lightAnimationBounds.m_min = Vec3(-64, 5.0f, -64);
+	m_lightAnimationBounds.m_max = Vec3(64, 1.0f, 64);
+
+	if (!m_config.modelName.empty())
+	{
+		Log::message("Loading model '%s'", m_config.modelName.c_str());
+		if (!m_model.read(m_config.modelName.c_str()))
+		{
+			Log::error("Failed to load model '%s'", m_config.modelName.c_str());
+			return false;
+		}
+		m_modelLoaded          = true;
+		m_lightAnimationBounds = m_model.bounds;
+	}
+
+	if (m_config.lightsOnGeometry)
+	{
+		if (!m_modelLoaded)
+		{
+			Log::error("Placing lights on geometry requires a model");
+			return false;
+		}
+		generateLightsOnGeometry(m_lights, m_model, m_config.lightCount, m_config.minLightIntensity,
+		    m_config.maxLightIntensity, m_config.randomSeed);
+	}
+	else
+	{
+		generateLights(m_lights, m_config.lightCount, m_lightAnimationBounds, m_config.minLightIntensity,
+		    m_config.maxLightIntensity, m_config.randomSeed);
+		animateLights(m_lights, m_lightAnimationBounds, 0.0f, (u32)m_lights.size());
+	}
+
+	if (m_config.useOcclusionCulling)
+	{
+		if (!m_modelLoaded)
+		{
+			Log::error("Occlusion culling requires a model");
+			return false;
+		}
+		m_occluderMesh.build(m_model);
+		Log::message("Occluder triangles: %d", (int)m_occluderMesh.getTriangleCount());
+	}
+
+	const float aspect = float(m_config.width) / float(m_config.height);
+	m_camera           = Camera(aspect, 1.0f, 0.25f, 10000.0f);
+
+	if (!m_config.replayName.empty())
+	{
+		FileIn stream(m_config.replayName.c_str());
+		if (!stream.valid())
+		{
+			Log::error("Failed to open camera replay '%s'", m_config.replayName.c_str());
+			return false;
+		}
+		readContainer(stream, m_cameraFrames);
+	}
+	else if (!m_config.cameraName.empty())
+	{
+		FileIn stream(m_config.cameraName.c_str());
+		if (!stream.valid())
+		{
+			Log::error("Failed to open camera '%s'", m_config.cameraName.c_str());
+			return false;
+		}
+		stream.readT(m_camera);
+		m_camera.setAspect(aspect);
+		m_useFixedCamera = true;
+		m_cameraFrames.resize(1);
+	}
+	else
+	{
+		m_cameraFrames = generateOrbitCameraFrames(m_lightAnimationBounds, m_config.orbitFrameCount);
+	}
+
+	if (m_cameraFrames.empty())
+	{
+		Log::error("Camera path is empty");
+		return false;
+	}
+
+	m_tiledLightTreeBuilderParams.resolution              = Tuple2u{m_config.width, m_config.height};
+	m_tiledLightTreeBuilderParams.tileSize                = m_config.tileSize;
+	m_tiledLightTreeBuilderParams.sliceCount              = 16;
+	m_tiledLightTreeBuilderParams.maxSliceDepth           = 60.0f;
+	m_tiledLightTreeBuilderParams.useExponentialSlices    = false;
+	m_tiledLightTreeBuilderParams.calculateTileLightCount = false;
+	m_tiledLightTreeBuilderParams.useTileFrustumCulling   = m_config.useTileFrustumCulling;
+	m_tiledLightTreeBuilderParams.useTileRowSpans         = m_config.useTileRowSpans;
+	m_tiledLightTreeBuilderParams.useShallowTree          = m_config.useShallowTree;
+	m_tiledLightTreeBuilderParams.useClippedLightExtents  = m_config.useClippedLightExtents;
+	m_tiledLightTreeBuilderParams.maxLightsPerCell        = m_config.maxLightsPerCell;
+
+	m_clusteredLightBuilderParams.resolution              = Tuple2u{m_config.width, m_config.height};
+	m_clusteredLightBuilderParams.tileSize                = m_config.tileSize;
+	m_clusteredLightBuilderParams.sliceCount              = 16;
+	m_clusteredLightBuilderParams.maxSliceDepth           = 500.0f;
+	m_clusteredLightBuilderParams.useExponentialSlices    = true;
+	m_clusteredLightBuilderParams.calculateTileLightCount = false;
+	m_clusteredLightBuilderParams.useTileFrustumCulling   = m_config.useTileFrustumCulling;
+	m_clusteredLightBuilderParams.useTileRowSpans         = m_config.useTileRowSpans;
+	m_clusteredLightBuilderParams.useClusterCulling       = m_config.useClusterCulling;
+	m_clusteredLightBuilderParams.maxLightsPerCell        = m_config.maxLightsPerCell;
+
+	if (m_config.forceLinearSlices || m_config.forceExponentialSlices)
+	{
+		m_tiledLightTreeBuilderParams.useExponentialSlices = m_config.forceExponentialSlices;
+		m_clusteredLightBuilderParams.useExponentialSlices = m_config.forceExponentialSlices;
+	}
+
+	if (m_config.useOcclusionCulling)
+	{
+		m_tiledLightTreeBuilderParams.occlusionBuffer = &m_occlusionBuffer;
+		m_clusteredLightBuilderParams.occlusionBuffer = &m_occlusionBuffer;
+	}
+
+	Log::message("Lights: %d, camera frames: %d, resolution: %dx%d, tile size: %d, SIMD: %s", (int)m_lights.size(),
+	    (int)m_cameraFrames.size(), m_config.width, m_config.height, m_config.tileSize,
+	    toString(m_config.simdIsa));
+
+	return true;
+}
+
+void Benchmark::setupFrame(u32 frameIndex)
+{
+	if (m_config.animateLights)
+	{
+		const float elapsedTime = float(frameIndex) / 60.0f;
+		animateLights(m_lights, m_lightAnimationBounds, elapsedTime, (u32)m_lights.size());
+	}
+
+	if (!m_useFixedCamera)
+	{
+		m_camera.lookAt(m_cameraFrames[frameIndex].position, m_cameraFrames[frameIndex].target);
+	}
+
+	m_matView = m_camera.buildViewMatrix();
+
+	m_viewTransformTime   = 0;
+	m_lightBvhUpdateTime  = 0;
+	m_occlusionRenderTime = 0;
+	m_lightBvhRebuilt     = false;
+
+	if (m_config.useOcclusionCulling)
+	{
+		Timer timer;
+		m_occlusionBuffer.render(m_camera, m_matView, m_occluderMesh, divUp(m_config.width, 8u),
+		    divUp(m_config.height, 8u));
+		m_occlusionRenderTime = timer.time();
+	}
+
+	if (m_cullMethod == CullMethod::ViewSpace)
+	{
+		Timer timer;
+		transformLightsToViewSpace(m_matView, m_lights, (u32)m_lights.size(), m_viewSpaceLights);
+		m_viewTransformTime = timer.time();
+	}
+	else if (m_cullMethod == CullMethod::Bvh)
+	{
+		// Static lights only need the tree to be built once, animated lights are refitted every frame
+		if (m_config.animateLights || m_lightBvh.getLightCount() != (u32)m_lights.size())
+		{
+			Timer timer;
+			m_lightBvhRebuilt    = m_lightBvh.update(m_lights.data(), (u32)m_lights.size());
+			m_lightBvhUpdateTime = timer.time();
+		}
+	}
+}
+
+template <typename F> void Benchmark::forEachFrame(F runFrame)
+{
+	const u32 totalIterations = m_config.warmupIterations + m_config.iterations;
+	for (u32 iteration = 0; iteration < totalIterations; ++iteration)
+	{
+		const bool measure = iteration >= m_config.warmupIterations;
+		for (u32 frameIndex = 0; frameIndex < (u32)m_cameraFrames.size(); ++frameIndex)
+		{
+			setupFrame(frameIndex);
+			runFrame(measure);
+		}
+	}
+}
+
+void Benchmark::runTiledLightTree(LightingMode mode, ModeResult& outResult)
+{
+	TiledLightTreeBuilder builder(MaxLights);
+
+	// Same configuration as LightCullApp::buildLighting()
+	TiledLightTreeBuildParams buildParams = m_tiledLightTreeBuilderParams;
+	if (mode == LightingMode::Tree)
+	{
+		buildParams.sliceCount    = 1;
+		buildParams.maxSliceDepth = 0;
+	}
+	else
+	{
+		buildParams.useShallowTree = false;
+	}
+
+	forEachFrame([&](bool measure) {
+		TiledLightTreeBuildResult stats;
+		switch (m_cullMethod)
+		{
+		default:
+		case CullMethod::ViewSpace: stats = builder.build(m_camera, m_viewSpaceLights, buildParams); break;
+		case CullMethod::WorldSpace:
+			stats = builder.build(m_camera, m_matView, m_lights, (u32)m_lights.size(), buildParams);
+			break;
+		case CullMethod::Bvh: stats = builder.build(m_camera, m_matView, m_lights, m_lightBvh, buildParams); break;
+		}
+
+		stats.lightCullTime += m_viewTransformTime + m_occlusionRenderTime;
+		stats.buildTotalTime += m_viewTransformTime + m_occlusionRenderTime + m_lightBvhUpdateTime;
+
+		if (measure)
+		{
+			outResult.lightBvh.samples.push_back(m_lightBvhUpdateTime);
+			outResult.lightCull.samples.push_back(stats.lightCullTime);
+			outResult.lightSort.samples.push_back(stats.lightSortTime);
+			outResult.lightAssign.samples.push_back(stats.lightAssignTime);
+			outResult.buildTree.samples.push_back(stats.buildTreeTime);
+			outResult.buildTotal.samples.push_back(stats.buildTotalTime);
+			outResult.visibleLightSum += stats.visibleLightCount;
+			outResult.dataSizeSum += stats.totalDataSize;
+			outResult.cappedLightSum += stats.cappedLightCount;
+			outResult.cappedImportanceSum += stats.cappedImportance;
+			outResult.lightBvhRebuildCount += m_lightBvhRebuilt;
+		}
+	});
+}
+
+void Benchmark::runClustered(ModeResult& outResult)
+{
+	ClusteredLightBuilder builder(MaxLights);
+
+	forEachFrame([&](bool measure) {
+		const auto& buildParams = m_clusteredLightBuilderParams;
+
+		ClusteredLightBuildResult stats;
+		switch (m_cullMethod)
+		{
+		default:
+		case CullMethod::ViewSpace: stats = builder.build(m_camera, m_viewSpaceLights, buildParams); break;
+		case CullMethod::WorldSpace:
+			stats = builder.build(m_camera, m_matView, m_lights, (u32)m_lights.size(), buildParams);
+			break;
+		case CullMethod::Bvh: stats = builder.build(m_camera, m_matView, m_lights, m_lightBvh, buildParams); break;
+		}
+
+		stats.lightCullTime += m_viewTransformTime + m_occlusionRenderTime;
+		stats.buildTotalTime += m_viewTransformTime + m_occlusionRenderTime + m_lightBvhUpdateTime;
+
+		if (measure)
+		{
+			outResult.lightBvh.samples.push_back(m_lightBvhUpdateTime);
+			outResult.lightCull.samples.push_back(stats.lightCullTime);
+			outResult.lightSort.samples.push_back(0.0);
+			outResult.lightAssign.samples.push_back(stats.lightAssignTime);
+			outResult.buildTree.samples.push_back(0.0);
+			outResult.buildTotal.samples.push_back(stats.buildTotalTime);
+			outResult.visibleLightSum += stats.visibleLightCount;
+			outResult.dataSizeSum += stats.totalDataSize;
+			outResult.cappedLightSum += stats.cappedLightCount;
+			outResult.cappedImportanceSum += stats.cappedImportance;
+			outResult.lightBvhRebuildCount += m_lightBvhRebuilt;
+		}
+	});
+}
+
+void Benchmark::run()
+{
+	FILE* csvFile = nullptr;
+	if (!m_config.csvName.empty())
+	{
+		csvFile = fopen(m_config.csvName.c_str(), "w");
+		if (csvFile)
+		{
+			fprintf(csvFile,
+			    "Mode, Sample, Light BVH (ms), Light cull (ms), Light sort (ms), Light assign (ms), Build tree (ms), "
+			    "Total (ms)\n");
+		}
+		else
+		{
+			Log::warning("Failed to open '%s' for writing", m_config.csvName.c_str());
+		}
+	}
+
+	auto runMode = [&](LightingMode mode) {
+		char modeName[64];
+		snprintf(modeName, sizeof(modeName), "%s (%s)", toString(mode), toString(m_cullMethod));
+
+		ModeResult result;
+		if (mode == LightingMode::Clustered)
+		{
+			runClustered(result);
+		}
+		else
+		{
+			runTiledLightTree(mode, result);
+		}
+
+		printModeResult(modeName, result);
+		if (csvFile)
+		{
+			writeModeResultCSV(csvFile, modeName, result);
+		}
+	};
+
+	for (int methodIndex = 0; methodIndex < (int)CullMethod::count; ++methodIndex)
+	{
+		if (!m_config.runCullMethod[methodIndex])
+		{
+			continue;
+		}
+
+		m_cullMethod = CullMethod(methodIndex);
+
+		if (m_config.runTree)
+		{
+			runMode(LightingMode::Tree);
+		}
+
+		if (m_config.runHybrid)
+		{
+			runMode(LightingMode::Hybrid);
+		}
+
+		if (m_config.runClustered)
+		{
+			runMode(LightingMode::Clustered);
+		}
+	}
+
+	if (csvFile)
+	{
+		fclose(csvFile);
+	}
+}
+
+bool Benchmark::validate()
+{
+	const bool lightGridValid = validateLightGrid();
+	const bool kernelsValid   = validateKernels();
+
+	return lightGridValid && kernelsValid;
+}
+
+// Compares clustered light grids built with all combinations of tile culling options against a brute force
+// assignment, which tests every tile within the screen space extents of each light in interval order
+bool Benchmark::validateLightGrid()
+{
+	ClusteredLightBuilder              builder(MaxLights);
+	ClusteredLightBuilder::BuildParams buildParams = m_clusteredLightBuilderParams;
+	buildParams.maxLightsPerCell                   = 0;
+
+	const u32 tileCountX    = divUp(m_config.width, m_config.tileSize);
+	const u32 tileCountY    = divUp(m_config.height, m_config.tileSize);
+	const u32 tilesPerSlice = tileCountX * tileCountY;
+	const u32 cellCount     = tilesPerSlice * buildParams.sliceCount;
+
+	const DepthExtentsCalculator depthExtentsCalculator(buildParams);
+	const float*                 sliceDistances = depthExtentsCalculator.sliceDistances.data();
+
+	std::vector<std::vector<u16>> expectedCells(cellCount);
+	std::vector<TileRowSpan>      rowSpans;
+
+	u64 testedCellCount = 0;
+	u64 errorCount      = 0;
+
+	m_cullMethod = CullMethod::WorldSpace;
+
+	for (u32 frameIndex = 0; frameIndex < (u32)m_cameraFrames.size(); ++frameIndex)
+	{
+		setupFrame(frameIndex);
+
+		const Mat4 matProj = m_camera.buildProjMatrix();
+		const Mat4 matProjScreenSpace =
+		    matProj * Mat4::scaleTranslate(Vec3(0.5f * m_config.width, -0.5f * m_config.height, 1.0f),
+		                  Vec3(0.5f * m_config.width, 0.5f * m_config.height, 0.0f));
+
+		const TileRowSpanCalculator tileRowSpanCalculator(
+		    matProjScreenSpace, m_camera.getNearPlane(), m_config.tileSize);
+
+		// Cluster culling is only done together with tile frustum culling
+		for (u32 options = 0; options < 8; ++options)
+		{
+			buildParams.useTileFrustumCulling = (options & 1) != 0;
+			buildParams.useTileRowSpans       = (options & 2) != 0;
+			buildParams.useClusterCulling     = (options & 4) != 0;
+
+			if (buildParams.useClusterCulling && !buildParams.useTileFrustumCulling)
+			{
+				continue;
+			}
+
+			builder.build(m_camera, m_matView, m_lights, (u32)m_lights.size(), buildParams);
+
+			for (std::vector<u16>& cell : expectedCells)
+			{
+				cell.clear();
+			}
+
+			for (const LightDepthInterval& interval : builder.m_lightIntervals)
+			{
+				const LightSource&                 light   = builder.m_gpuLights[interval.lightIndex];
+				const LightTileScreenSpaceExtents& extents = builder.m_lightScreenSpaceExtents[interval.lightIndex];
+				const Vec4                         sphere  = Vec4(light.position, light.attenuationEnd);
+
+				rowSpans.resize(1 + extents.tileMax.y - extents.tileMin.y);
+				tileRowSpanCalculator.calculateTileRowSpans(light, extents, rowSpans.data());
+
+				for (u32 y = extents.tileMin.y; y <= extents.tileMax.y; ++y)
+				{
+					for (u32 x = extents.tileMin.x; x <= extents.tileMax.x; ++x)
+					{
+						const TileRowSpan& span      = rowSpans[y - extents.tileMin.y];
+						const u32          tileIndex = x + y * tileCountX;
+
+						if (buildParams.useTileRowSpans && (x < span.tileMinX || x > span.tileMaxX))
+						{
+							continue;
+						}
+
+						LightTileDepthExtents depthExtents = interval.depthExtents;
+
+						if (buildParams.useTileFrustumCulling)
+						{
+							Vec3 corners[4];
+							Vec3 frustumSidePlanes[4];
+							builder.m_tileFrustumCache.getTileFrustum(tileIndex, corners, frustumSidePlanes);
+
+							if (!testTileFrustumSphere(corners, frustumSidePlanes, sphere))
+							{
+								continue;
+							}
+
+							if (buildParams.useClusterCulling && depthExtents.sliceMin != depthExtents.sliceMax &&
+							    !builder.m_tileFrustumCache.cullSlices(tileIndex, sphere, sliceDistances, depthExtents))
+							{
+								continue;
+							}
+						}
+
+						for (u32 z = depthExtents.sliceMin; z <= depthExtents.sliceMax; ++z)
+						{
+							expectedCells[tileIndex + z * tilesPerSlice].push_back(interval.lightIndex);
+						}
+					}
+				}
+			}
+
+			u32 expectedItemCount = 0;
+			for (u32 cellIndex = 0; cellIndex < cellCount; ++cellIndex)
+			{
+				const std::vector<u16>& expected = expectedCells[cellIndex];
+				const auto&             cell     = builder.m_lightGrid[cellIndex];
+				const u16*              actual   = builder.m_gpuLightIndices.data() + cell.lightOffset;
+
+				const bool cellValid =
+				    cell.lightCount == expected.size() && std::equal(expected.begin(), expected.end(), actual);
+
+				if (!cellValid)
+				{
+					if (errorCount < 10)
+					{
+						Log::error("Frame %d, options %d, cell %d: expected %d lights, got %d", frameIndex, options,
+						    cellIndex, (int)expected.size(), cell.lightCount);
+					}
+					++errorCount;
+				}
+
+				expectedItemCount += (u32)expected.size();
+			}
+
+			errorCount += expectedItemCount != builder.m_gpuLightIndices.size();
+			testedCellCount += cellCount;
+		}
+	}
+
+	printf("Light grid: %llu cells tested, %llu errors\n", (unsigned long long)testedCellCount,
+	    (unsigned long long)errorCount);
+
+	return errorCount == 0;
+}
+
+bool Benchmark::validateKernels()
+{
+	std::vector<SimdIsa> simdIsas;
+	for (u32 i = (u32)SimdIsa::Scalar + 1; i < (u32)SimdIsa::count; ++i)
+	{
+		if (isSimdIsaSupported((SimdIsa)i))
+		{
+			simdIsas.push_back((SimdIsa)i);
+		}
+	}
+
+	if (simdIsas.empty())
+	{
+		printf("SIMD kernels are not supported on this machine, skipping kernel validation\n");
+		return true;
+	}
+
+	// Tiled light tree uses linear slices, clustered uses exponential ones
+	TiledLightTreeBuildParams treeParams = m_tiledLightTreeBuilderParams;
+	treeParams.resolution                = Tuple2u{m_config.width, m_config.height};
+	treeParams.tileSize                  = m_config.tileSize;
+
+	const CommonLightBuildParams* paramsList[] = {&treeParams, &m_clusteredLightBuilderParams};
+
+	const u32 tileCountX = divUp(m_config.width, m_config.tileSize);
+	const u32 tileCountY = divUp(m_config.height, m_config.tileSize);
+
+	AlignedArray<u32>                visibleLightIndices;
+	AlignedArray<LightDepthInterval> intervals;
+	std::vector<LightSource>         visibleLights;
+	LightSpheresSoA                  visibleLightSpheres;
+	TileFrustumCache                 tileFrustumCache;
+
+	std::vector<LightDepthInterval>          scalarIntervals, simdIntervals;
+	std::vector<LightTileScreenSpaceExtents> scalarExtents, simdExtents;
+
+	struct IsaStats
+	{
+		u64    errorCount        = 0;
+		u64    tileMismatchCount = 0;
+		u64    cullingErrorCount = 0;
+		double extentsTime       = 0;
+
+		u64    transformErrorCount = 0;
+		float  transformMaxError   = 0;
+		double transformTime       = 0;
+	};
+
+	IsaStats isaStats[(u32)SimdIsa::count];
+
+	u64 testedCount      = 0;
+	u64 testedGroupCount = 0;
+
+	m_cullMethod = CullMethod::WorldSpace;
+
+	for (u32 frameIndex = 0; frameIndex < (u32)m_cameraFrames.size(); ++frameIndex)
+	{
+		setupFrame(frameIndex);
+
+		const Mat4          matProj = m_camera.buildProjMatrix();
+		const FrustumPlanes worldSpaceFrustum(m_matView * matProj);
+
+		performLightCullingAndTransform(worldSpaceFrustum, m_matView, m_lights.data(), (u32)m_lights.size(),
+		    visibleLightIndices, intervals, visibleLights);
+
+		const u32 intervalCount = (u32)intervals.size();
+
+		for (const CommonLightBuildParams* buildParams : paramsList)
+		{
+			const DepthExtentsCalculator depthExtentsCalculator(*buildParams);
+
+			LightExtentsParams params;
+			params.matProjScreenSpace =
+			    matProj * Mat4::scaleTranslate(Vec3(0.5f * m_config.width, -0.5f * m_config.height, 1.0f),
+			                  Vec3(0.5f * m_config.width, 0.5f * m_config.height, 0.0f));
+			params.cameraNearZ            = m_camera.getNearPlane();
+			params.tileSize               = m_config.tileSize;
+			params.tileCountX             = tileCountX;
+			params.tileCountY             = tileCountY;
+			params.depthExtentsCalculator = &depthExtentsCalculator;
+
+			scalarIntervals.assign(intervals.begin(), intervals.end());
+			scalarExtents.assign(visibleLights.size(), LightTileScreenSpaceExtents{});
+
+			Timer timer;
+			computeLightExtents(SimdIsa::Scalar, params, visibleLights.data(), scalarIntervals.data(), intervalCount,
+			    scalarExtents.data());
+			isaStats[(u32)SimdIsa::Scalar].extentsTime += timer.time();
+
+			for (SimdIsa isa : simdIsas)
+			{
+				IsaStats& stats = isaStats[(u32)isa];
+
+				simdIntervals.assign(intervals.begin(), intervals.end());
+				simdExtents.assign(visibleLights.size(), LightTileScreenSpaceExtents{});
+
+				timer.reset();
+				computeLightExtents(
+				    isa, params, visibleLights.data(), simdIntervals.data(), intervalCount, simdExtents.data());
+				stats.extentsTime += timer.time();
+
+				for (u32 i = 0; i < intervalCount; ++i)
+				{
+					const u32                          lightIndex = intervals[i].lightIndex;
+					const LightTileScreenSpaceExtents& expected   = scalarExtents[lightIndex];
+					const LightTileScreenSpaceExtents& actual     = simdExtents[lightIndex];
+
+					// Approximate reciprocal and fast math make the boxes differ slightly, so tiles may differ when a
+					// box edge is close to a tile boundary. SIMD tiles must still match its own box exactly.
+					// Some degenerate lights produce NaN boxes in both paths. NaN is tested on the bit pattern, since
+					// isnan() may be optimized out with fast math enabled.
+					auto isNaN      = [](float v) { return (asUint(v) & 0x7FFFFFFF) > 0x7F800000; };
+					auto boxMatches = [&](float a, float b) {
+						return (isNaN(a) && isNaN(b)) || fabsf(a - b) <= 1e-3f * max(1.0f, fabsf(b));
+					};
+					auto getTile = [&](float v, u32 tileCount) {
+						return (u32)min(max((int)v / (int)m_config.tileSize, 0), (int)tileCount - 1);
+					};
+
+					const Box2& box = actual.screenSpaceBox;
+
+					const bool boxValid = boxMatches(box.m_min.x, expected.screenSpaceBox.m_min.x) &&
+					                      boxMatches(box.m_min.y, expected.screenSpaceBox.m_min.y) &&
+					                      boxMatches(box.m_max.x, expected.screenSpaceBox.m_max.x) &&
+					                      boxMatches(box.m_max.y, expected.screenSpaceBox.m_max.y);
+
+					const bool tilesValid = actual.tileMin.x == getTile(box.m_min.x, tileCountX) &&
+					                        actual.tileMin.y == getTile(box.m_min.y, tileCountY) &&
+					                        actual.tileMax.x == getTile(box.m_max.x, tileCountX) &&
+					                        actual.tileMax.y == getTile(box.m_max.y, tileCountY);
+
+					const bool slicesValid =
+					    simdIntervals[i].depthExtents.sliceMin == scalarIntervals[i].depthExtents.sliceMin &&
+					    simdIntervals[i].depthExtents.sliceMax == scalarIntervals[i].depthExtents.sliceMax;
+
+					if (!boxValid || !tilesValid || !slicesValid)
+					{
+						if (stats.errorCount < 10)
+						{
+							Log::error("Frame %d, light %d: scalar box (%f %f %f %f) slices [%d %d], "
+							           "%s box (%f %f %f %f) slices [%d %d]",
+							    frameIndex, lightIndex, expected.screenSpaceBox.m_min.x,
+							    expected.screenSpaceBox.m_min.y, expected.screenSpaceBox.m_max.x,
+							    expected.screenSpaceBox.m_max.y, scalarIntervals[i].depthExtents.sliceMin,
+							    scalarIntervals[i].depthExtents.sliceMax, toString(isa), box.m_min.x, box.m_min.y,
+							    box.m_max.x, box.m_max.y, simdIntervals[i].depthExtents.sliceMin,
+							    simdIntervals[i].depthExtents.sliceMax);
+						}
+						++stats.errorCount;
+					}
+
+					stats.tileMismatchCount += actual.tileMin.x != expected.tileMin.x ||
+					                           actual.tileMin.y != expected.tileMin.y ||
+					                           actual.tileMax.x != expected.tileMax.x ||
+					                           actual.tileMax.y != expected.tileMax.y;
+				}
+			}
+
+			testedCount += intervalCount;
+		}
+
+		// Culling kernels return bit masks, which are compared for view space spheres of visible lights against the
+		// view frustum and against tile frustums within their scalar tile bounds
+
+		const FrustumPlanes viewSpaceFrustum(matProj);
+
+		visibleLightSpheres.build(visibleLights);
+		tileFrustumCache.build(m_camera.getFov(), m_camera.getAspect(), m_config.tileSize, tileCountX, tileCountY,
+		    m_config.width);
+
+		const LightingKernels& scalarKernels = getLightingKernels(SimdIsa::Scalar);
+		const u32              lightCount    = (u32)visibleLights.size();
+
+		for (u32 groupBegin = 0; groupBegin < lightCount; groupBegin += LightSpheresSoA::GroupSize)
+		{
+			auto testGroup = [&](const LightingKernels& kernels) {
+				return kernels.testLightSphereGroup(viewSpaceFrustum, &visibleLightSpheres.x[groupBegin],
+				    &visibleLightSpheres.y[groupBegin], &visibleLightSpheres.z[groupBegin],
+				    &visibleLightSpheres.r[groupBegin]);
+			};
+
+			const u32 expected = testGroup(scalarKernels);
+			for (SimdIsa isa : simdIsas)
+			{
+				isaStats[(u32)isa].cullingErrorCount += testGroup(getLightingKernels(isa)) != expected;
+			}
+
+			++testedGroupCount;
+		}
+
+		for (u32 lightIndex = 0; lightIndex < lightCount; ++lightIndex)
+		{
+			const LightSource&                 light   = visibleLights[lightIndex];
+			const LightTileScreenSpaceExtents& extents = scalarExtents[lightIndex];
+			const Vec4                         sphere  = Vec4(light.position, light.attenuationEnd);
+
+			for (u32 y = extents.tileMin.y; y <= extents.tileMax.y; ++y)
+			{
+				for (u32 x = extents.tileMin.x; x <= extents.tileMax.x; x += TileFrustumCache::GroupSize)
+				{
+					const u32 firstTileIndex = x + y * tileCountX;
+					const u32 groupTileCount = min(extents.tileMax.x + 1 - x, TileFrustumCache::GroupSize);
+					const u32 validMask      = (1u << groupTileCount) - 1;
+
+					const u32 expected =
+					    scalarKernels.testTileFrustumSphereGroup(tileFrustumCache, firstTileIndex, sphere) & validMask;
+					for (SimdIsa isa : simdIsas)
+					{
+						const u32 actual =
+						    getLightingKernels(isa).testTileFrustumSphereGroup(tileFrustumCache, firstTileIndex, sphere);
+						isaStats[(u32)isa].cullingErrorCount += (actual & validMask) != expected;
+					}
+
+					++testedGroupCount;
+				}
+			}
+		}
+	}
+
+	// Batched point transform is compared against transformPoint() for all scene lights, using the last frame's view.
+	// Fused multiply-adds may change the last bits, so errors are relative to the magnitude of the summed terms.
+
+	static constexpr u32 TransformRepeatCount = 64;
+
+	const u32 pointCount = (u32)m_lights.size();
+
+	std::vector<Vec3>  positions(pointCount), expectedPositions(pointCount);
+	std::vector<float> inX(pointCount), inY(pointCount), inZ(pointCount);
+	std::vector<float> outX(pointCount), outY(pointCount), outZ(pointCount);
+
+	for (u32 i = 0; i < pointCount; ++i)
+	{
+		positions[i] = m_lights[i].position;
+		inX[i]       = positions[i].x;
+		inY[i]       = positions[i].y;
+		inZ[i]       = positions[i].z;
+	}
+
+	Timer timer;
+	for (u32 repeat = 0; repeat < TransformRepeatCount; ++repeat)
+	{
+		for (u32 i = 0; i < pointCount; ++i)
+		{
+			expectedPositions[i] = transformPoint(m_matView, positions[i]);
+		}
+	}
+	const double perPointTransformTime = timer.time() / TransformRepeatCount;
+
+	const float translationLength = m_matView.rows[3].xyz().length();
+
+	std::vector<SimdIsa> transformIsas = simdIsas;
+	transformIsas.insert(transformIsas.begin(), SimdIsa::Scalar);
+
+	for (SimdIsa isa : transformIsas)
+	{
+		IsaStats&              stats   = isaStats[(u32)isa];
+		const LightingKernels& kernels = getLightingKernels(isa);
+
+		timer.reset();
+		for (u32 repeat = 0; repeat < TransformRepeatCount; ++repeat)
+		{
+			kernels.transformPoints(
+			    m_matView, inX.data(), inY.data(), inZ.data(), outX.data(), outY.data(), outZ.data(), pointCount);
+		}
+		stats.transformTime = timer.time() / TransformRepeatCount;
+
+		for (u32 i = 0; i < pointCount; ++i)
+		{
+			const Vec3& expected = expectedPositions[i];
+
+			const float error = max(max(fabsf(outX[i] - expected.x), fabsf(outY[i] - expected.y)),
+			    fabsf(outZ[i] - expected.z));
+
+			stats.transformMaxError = max(stats.transformMaxError, error);
+			stats.transformErrorCount += error > 1e-5f * (1.0f + positions[i].length() + translationLength);
+		}
+	}
+
+	printf("Light extents: %llu intervals tested, culling: %llu sphere and tile groups tested\n",
+	    (unsigned long long)testedCount, (unsigned long long)testedGroupCount);
+	printf("  %-8s %9.3f ms\n", toString(SimdIsa::Scalar), isaStats[(u32)SimdIsa::Scalar].extentsTime * 1000.0);
+
+	bool result = true;
+
+	for (SimdIsa isa : simdIsas)
+	{
+		const IsaStats& stats = isaStats[(u32)isa];
+
+		printf("  %-8s %9.3f ms, %llu errors, %llu with different tiles, %llu culling mask errors\n", toString(isa),
+		    stats.extentsTime * 1000.0, (unsigned long long)stats.errorCount,
+		    (unsigned long long)stats.tileMismatchCount, (unsigned long long)stats.cullingErrorCount);
+
+		result &= stats.errorCount == 0 && stats.cullingErrorCount == 0;
+	}
+
+	printf("Point transform: %u points, per point transformPoint() %.3f us\n", pointCount,
+	    perPointTransformTime * 1e6);
+
+	for (SimdIsa isa : transformIsas)
+	{
+		const IsaStats& stats = isaStats[(u32)isa];
+
+		printf("  %-8s %9.3f us, max error %g, %llu errors\n", toString(isa), stats.transformTime * 1e6,
+		    stats.transformMaxError, (unsigned long long)stats.transformErrorCount);
+
+		result &= stats.transformErrorCount == 0;
+	}
+
+	return result;
+}
+
+// Sorts random light depths with their indices as payload. Bucket sort is the approximate 512 bucket counting sort
+// that tree cells used to order their lights, which does not produce exact order and is only timed.
+bool runSortBenchmark(const BenchConfig& config)
+{
+	static const u32 elementCounts[] = {1024, 4096, 16384, 65536, 262144, 1048576};
+
+	struct KeyValue
+	{
+		float key;
+		u32   value;
+	};
+
+	Rand rng(config.randomSeed);
+
+	std::vector<float>    depths;
+	std::vector<u32>      keys, values;
+	std::vector<KeyValue> keyValues, expected;
+	RadixSortBuffers      sortBuffers;
+
+	PhaseStats radixStats  = {"radix"};
+	PhaseStats stdStats    = {"std::sort"};
+	PhaseStats bucketStats = {"bucket"};
+
+	bool result = true;
+
+	printf("Sort: %u iterations, median time (ms)\n", config.iterations);
+	printf("  %9s %9s %9s %9s\n", "elements", radixStats.name, stdStats.name, bucketStats.name);
+
+	for (u32 count : elementCounts)
+	{
+		depths.resize(count);
+		for (float& depth : depths)
+		{
+			depth = rng.getFloat(-10.0f, 1000.0f);
+		}
+
+		expected.resize(count);
+		for (u32 i = 0; i < count; ++i)
+		{
+			expected[i] = KeyValue{depths[i], i};
+		}
+
+		std::stable_sort(
+		    expected.begin(), expected.end(), [](const KeyValue& a, const KeyValue& b) { return a.key < b.key; });
+
+		radixStats.samples.clear();
+		stdStats.samples.clear();
+		bucketStats.samples.clear();
+
+		u32 errorCount = 0;
+
+		for (u32 iteration = 0; iteration < config.warmupIterations + config.iterations; ++iteration)
+		{
+			const bool measure = iteration >= config.warmupIterations;
+
+			Timer timer;
+			keys.resize(count);
+			values.resize(count);
+			parallelFor<u32>(0, count, [&](u32 i) {
+				keys[i]   = getSortableFloatBits(depths[i]);
+				values[i] = i;
+			});
+			parallelRadixSort(keys.data(), values.data(), count, 32, sortBuffers);
+			const double radixTime = timer.time();
+
+			for (u32 i = 0; i < count; ++i)
+			{
+				errorCount += values[i] != expected[i].value;
+			}
+
+			timer.reset();
+			keyValues.resize(count);
+			for (u32 i = 0; i < count; ++i)
+			{
+				keyValues[i] = KeyValue{depths[i], i};
+			}
+			std::sort(keyValues.begin(), keyValues.end(),
+			    [](const KeyValue& a, const KeyValue& b) { return a.key < b.key; });
+			const double stdTime = timer.time();
+
+			timer.reset();
+			{
+				static constexpr u32 BucketCount = 512;
+
+				u32   buckets[BucketCount] = {};
+				float depthMax             = 0.0f;
+
+				for (u32 i = 0; i < count; ++i)
+				{
+					depthMax = max(depthMax, depths[i]);
+				}
+
+				const float depthScale = float(BucketCount) / depthMax;
+
+				auto getBucket = [depthScale](float depth)
+				{
+					return clamp<int>(int(depthScale * depth), 0, int(BucketCount - 1));
+				};
+
+				for (u32 i = 0; i < count; ++i)
+				{
+					buckets[getBucket(depths[i])]++;
+				}
+
+				u32 offset = 0;
+				for (u32& bucket : buckets)
+				{
+					const u32 bucketItemCount = bucket;
+					bucket                    = offset;
+					offset += bucketItemCount;
+				}
+
+				for (u32 i = 0; i < count; ++i)
+				{
+					values[buckets[getBucket(depths[i])]++] = i;
+				}
+			}
+			const double bucketTime = timer.time();
+
+			if (measure)
+			{
+				radixStats.samples.push_back(radixTime);
+				stdStats.samples.push_back(stdTime);
+				bucketStats.samples.push_back(bucketTime);
+			}
+		}
+
+		for (PhaseStats* stats : {&radixStats, &stdStats, &bucketStats})
+		{
+			std::sort(stats->samples.begin(), stats->samples.end());
+		}
+
+		printf("  %9u %9.3f %9.3f %9.3f", count, getPercentile(radixStats.samples, 50.0) * 1000.0,
+		    getPercentile(stdStats.samples, 50.0) * 1000.0, getPercentile(bucketStats.samples, 50.0) * 1000.0);
+		if (errorCount)
+		{
+			printf(", %u radix sort errors", errorCount);
+		}
+		printf("\n");
+
+		result &= errorCount == 0;
+	}
+
+	return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+
+	if (!parseCommandLine(argc, argv, config))
+	{
+		printUsage();
+		return 1;
+	}
+
+	setActiveSimdIsa(config.simdIsa);
+
+	if (config.sortBenchmark)
+	{
+		return runSortBenchmark(config) ? 0 : 1;
+	}
+
+	Benchmark benchmark(config);
+
+	if (!benchmark.setupScene())
+	{
+		return 1;
+	}
+
+	if (config.validate)
+	{
+		return benchmark.validate() ? 0 : 1;
+	}
+
+	benchmark.run();
+
+	return 0;
+}
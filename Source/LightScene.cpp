@@ -0,0 +1,228 @@
+#include "LightScene.h"
+#include "DiscreteDistribution.h"
+#include "Utils.h"
+
+#include <Rush/UtilLog.h>
+#include <Rush/UtilRandom.h>
+
+inline Vec3 generateDirection(Rand& rng)
+{
+	float u1 = rng.getFloat(0.0f, 1.0f);
+	float u2 = rng.getFloat(0.0f, 1.0f);
+
+	float z   = 1.0f - 2.0f * u1;
+	float r   = sqrtf(max(0.0f, 1.0f - z * z));
+	float phi = TwoPi * u2;
+
+	float x = r * cosf(phi);
+	float y = r * sinf(phi);
+
+	return Vec3(x, y, z);
+}
+
+void generateLights(std::vector<AnimatedLightSource>& outLights, u32 count, const Box3& bounds, float minIntensity,
+    float maxIntensity, u32 randomSeed)
+{
+	Rand rng = Rand(randomSeed);
+
+	outLights.clear();
+
+	float minLightRadius = FLT_MAX;
+	float maxLightRadius = -FLT_MAX;
+	float avgLightRadius = 0;
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		AnimatedLightSource light = {};
+
+		light.position.x = rng.getFloat(bounds.m_min.x, bounds.m_max.x);
+		light.position.y = rng.getFloat(bounds.m_min.y, bounds.m_max.y);
+		light.position.z = rng.getFloat(bounds.m_min.z, bounds.m_max.z);
+
+		light.originalPosition = light.position;
+
+		light.movementDirection   = generateDirection(rng);
+		light.movementDirection.x = abs(light.movementDirection.x);
+		light.movementDirection.y = abs(light.movementDirection.y);
+		light.movementDirection.z = abs(light.movementDirection.z);
+
+		light.intensity.x = rng.getFloat(minIntensity, maxIntensity);
+		light.intensity.y = rng.getFloat(minIntensity, maxIntensity);
+		light.intensity.z = rng.getFloat(minIntensity, maxIntensity);
+
+		const float intensity                     = dot(light.intensity, Vec3(1.0f / 3.0f));
+		const float attenuationIntensityThreshold = 0.025f;
+		light.attenuationEnd                      = intensity / sqrtf(attenuationIntensityThreshold);
+
+		minLightRadius = min(minLightRadius, light.attenuationEnd);
+		maxLightRadius = max(maxLightRadius, light.attenuationEnd);
+		avgLightRadius += light.attenuationEnd;
+
+		outLights.push_back(light);
+	}
+
+	avgLightRadius /= count;
+
+	Log::message("Light radius range: %f .. %f", minLightRadius, maxLightRadius);
+	Log::message("Average light radius: %f", avgLightRadius);
+}
+
+inline Vec3 computeTriangleNormal(Vec3 a, Vec3 b, Vec3 c) { return normalize(cross(c - a, c - b)); }
+
+inline float computeTriangleArea(Vec3 a, Vec3 b, Vec3 c) { return length(cross(c - a, c - b)) * 0.5f; }
+
+void generateLightsOnGeometry(std::vector<AnimatedLightSource>& outLights, const Model& model, u32 count,
+    float minIntensity, float maxIntensity, u32 randomSeed)
+{
+	Rand rng = Rand(randomSeed);
+
+	outLights.clear();
+
+	float minLightRadius = FLT_MAX;
+	float maxLightRadius = -FLT_MAX;
+	float avgLightRadius = 0;
+
+	std::vector<float> triangleAreas;
+	std::vector<Vec3>  triangleNormals;
+
+	u32 triangleCount = (u32)model.indices.size() / 3;
+
+	if (triangleCount == 0)
+		return;
+
+	triangleAreas.resize(triangleCount);
+	triangleNormals.resize(triangleCount);
+
+	struct Triangle
+	{
+		Vec3 a, b, c;
+	};
+
+	auto getTriangle = [&](u32 triangleIndex) {
+		Triangle result;
+
+		u32 indices[3] = {model.indices[triangleIndex * 3 + 0], model.indices[triangleIndex * 3 + 1],
+		    model.indices[triangleIndex * 3 + 2]};
+
+		result.a = model.vertices[indices[0]].position;
+		result.b = model.vertices[indices[1]].position;
+		result.c = model.vertices[indices[2]].position;
+
+		return result;
+	};
+
+	parallelFor<u32>(0, triangleCount, [&](u32 triangleIndex) {
+		Triangle tri                   = getTriangle(triangleIndex);
+		float    area                  = computeTriangleArea(tri.a, tri.b, tri.c);
+		Vec3     normal                = computeTriangleNormal(tri.a, tri.b, tri.c);
+		triangleAreas[triangleIndex]   = area;
+		triangleNormals[triangleIndex] = normal;
+	});
+
+	float triangleAreaSum = 0.0;
+	for (u32 i = 0; i < triangleCount; ++i)
+	{
+		triangleAreaSum += triangleAreas[i];
+	}
+
+	DiscreteDistribution<float> distribution(triangleAreas.data(), triangleCount, triangleAreaSum);
+
+	outLights.reserve(count);
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		u32 triangleIndex = (u32)distribution(rng.rand(), rng.getFloat(0.0f, 1.0f));
+
+		if (triangleAreas[triangleIndex] == 0.0f)
+			continue;
+
+		Triangle tri = getTriangle(triangleIndex);
+
+		AnimatedLightSource light = {};
+
+		light.originalPosition  = light.position;
+		light.movementDirection = Vec3(0.0);
+
+		light.intensity.x = rng.getFloat(minIntensity, maxIntensity);
+		light.intensity.y = rng.getFloat(minIntensity, maxIntensity);
+		light.intensity.z = rng.getFloat(minIntensity, maxIntensity);
+
+		const float intensity                     = dot(light.intensity, Vec3(1.0f / 3.0f));
+		const float attenuationIntensityThreshold = 0.025f;
+		light.attenuationEnd                      = intensity / sqrtf(attenuationIntensityThreshold);
+
+		float u, v;
+		for (;;)
+		{
+			u = rng.getFloat(0.0f, 1.0f);
+			v = rng.getFloat(0.0f, 1.0f);
+			if (u + v <= 1)
+				break;
+		}
+		float w        = 1.0f - u - v;
+		light.position = tri.a * u + tri.b * v + tri.c * w;
+		light.position += triangleNormals[triangleIndex] * light.attenuationEnd * 0.25f;
+
+		minLightRadius = min(minLightRadius, light.attenuationEnd);
+		maxLightRadius = max(maxLightRadius, light.attenuationEnd);
+		avgLightRadius += light.attenuationEnd;
+
+		outLights.push_back(light);
+	}
+
+	avgLightRadius /= count;
+
+	Log::message("Light radius range: %f .. %f", minLightRadius, maxLightRadius);
+	Log::message("Average light radius: %f", avgLightRadius);
+}
+
+inline float frac(float value) { return value - floorf(value); }
+
+void animateLights(std::vector<AnimatedLightSource>& lights, const Box3& bounds, float elapsedTime, u32 lightCount)
+{
+	Vec3 worldSize   = bounds.dimensions();
+	Vec3 worldOffset = bounds.m_min;
+
+	Vec3 animationSpeed = Vec3(10.0f, 0.01f, 10.0f);
+
+	lightCount = min<u32>(lightCount, (u32)lights.size());
+
+	for (u32 i = 0; i < lightCount; ++i)
+	{
+		auto& light = lights[i];
+
+		if (light.movementDirection == Vec3(0.0f))
+			continue;
+
+		Vec3 o = (light.originalPosition - worldOffset) / worldSize;
+		Vec3 p = o + (light.movementDirection * (elapsedTime * animationSpeed)) / worldSize;
+
+		int mx = (int)p.x % 2;
+		int my = (int)p.y % 2;
+		int mz = (int)p.z % 2;
+
+		p.x = mx ? frac(p.x) : 1.0f - frac(p.x);
+		p.y = my ? frac(p.y) : 1.0f - frac(p.y);
+		p.z = mz ? frac(p.z) : 1.0f - frac(p.z);
+
+		light.position = p * worldSize + worldOffset;
+	}
+}
+
+void transformLightsToViewSpace(const Mat4& matView, const std::vector<AnimatedLightSource>& lights, u32 lightCount,
+    std::vector<LightSource>& outViewSpaceLights)
+{
+	lightCount = min<u32>(lightCount, (u32)lights.size());
+
+	if (outViewSpaceLights.size() != lightCount)
+	{
+		outViewSpaceLights.resize(lightCount);
+	}
+
+	parallelForEach(outViewSpaceLights.begin(), outViewSpaceLights.end(), [&](LightSource& viewSpaceLight) {
+		u64                        i     = &viewSpaceLight - outViewSpaceLights.data();
+		const AnimatedLightSource& light = lights[i];
+		viewSpaceLight                   = light;
+		viewSpaceLight.position          = transformPoint(matView, light.position);
+	});
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "LightingCommon.h"
+#include "Model.h"
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+// Light setup and camera paths shared by LightCullApp and LightCullBench
+
+struct CameraKeyFrame
+{
+	Vec3 position;
+	Vec3 target;
+};
+
+// Scatters lights uniformly inside the bounding box. Lights move along random directions when animated.
+void generateLights(std::vector<AnimatedLightSource>& outLights, u32 count, const Box3& bounds, float minIntensity,
+    float maxIntensity, u32 randomSeed);
+
+// Places static lights slightly above the surface of the model, distributed proportionally to triangle area.
+void generateLightsOnGeometry(std::vector<AnimatedLightSource>& outLights, const Model& model, u32 count,
+    float minIntensity, float maxIntensity, u32 randomSeed);
+
+void animateLights(std::vector<AnimatedLightSource>& lights, const Box3& bounds, float elapsedTime, u32 lightCount);
+
+void transformLightsToViewSpace(const Mat4& matView, const std::vector<AnimatedLightSource>& lights, u32 lightCount,
+    std::vector<LightSource>& outViewSpaceLights);
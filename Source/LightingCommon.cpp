@@ -1,4 +1,5 @@
 #include "LightingCommon.h"
+#include "LightingKernels.h"
 #include "Utils.h"
 
 inline void getBoundsForAxis(const Vec3& axis, const Vec3& C, float r, float nearZ, Vec3& L, Vec3& U)
@@ -81,62 +82,760 @@ inline Box2 computeProjectedBoundingBoxFast(const Mat4& matProj, const Vec3& C,
 	    projectPoint(matProj, top).y);
 }
 
-u32 performLightBinning(const DepthExtentsCalculator& depthExtentsCalculator, const Mat4& matProjScreenSpace,
-    const float cameraNearZ, int tileSize, int tileCountX, int tileCountY, const std::vector<LightSource>& lights,
-    AlignedArray<LightDepthInterval>& inOutCulledLights, LightTileScreenSpaceExtents* outLightScreenSpaceExtents,
-    u16* outCellLightCount)
+#if LIGHTCULL_SIMD_KERNELS
+// Implemented in LightingKernels*.cpp, which are compiled with their own instruction set flags
+LightingKernels getLightingKernelsSse41();
+LightingKernels getLightingKernelsAvx2();
+LightingKernels getLightingKernelsAvx512();
+#endif
+
+template <bool UseExponentialSlices>
+static void computeLightExtentsScalar(const LightExtentsParams& params,
+    const LightSource*                                          lights,
+    LightDepthInterval*                                         inOutIntervals,
+    u32                                                         intervalCount,
+    LightTileScreenSpaceExtents*                                outLightScreenSpaceExtents)
 {
-	const u32 tilesPerSlice = tileCountX * tileCountY;
+	const int tileSize   = (int)params.tileSize;
+	const int tileCountX = (int)params.tileCountX;
+	const int tileCountY = (int)params.tileCountY;
 
-#if USE_PARALLEL_ALGORITHMS
-	parallelForEach(inOutCulledLights.begin(), inOutCulledLights.end(),
-	    [&](LightDepthInterval& interval)
-#else
-	for (LightDepthInterval& interval : inOutCulledLights)
-#endif
-	    {
-		    const LightSource&           light   = lights[interval.lightIndex];
-		    LightTileScreenSpaceExtents& extents = outLightScreenSpaceExtents[interval.lightIndex];
+	for (u32 intervalIndex = 0; intervalIndex < intervalCount; ++intervalIndex)
+	{
+		LightDepthInterval&          interval = inOutIntervals[intervalIndex];
+		const LightSource&           light    = lights[interval.lightIndex];
+		LightTileScreenSpaceExtents& extents  = outLightScreenSpaceExtents[interval.lightIndex];
 
-		    extents.screenSpaceBox =
-		        computeProjectedBoundingBox(matProjScreenSpace, light.position, light.attenuationEnd, cameraNearZ);
+		extents.screenSpaceBox = computeProjectedBoundingBox(
+		    params.matProjScreenSpace, light.position, light.attenuationEnd, params.cameraNearZ);
 
-		    extents.tileMin.x = min(max((int)extents.screenSpaceBox.m_min.x / tileSize, 0), tileCountX - 1);
-		    extents.tileMin.y = min(max((int)extents.screenSpaceBox.m_min.y / tileSize, 0), tileCountY - 1);
-		    extents.tileMax.x = min(max((int)extents.screenSpaceBox.m_max.x / tileSize, 0), tileCountX - 1);
-		    extents.tileMax.y = min(max((int)extents.screenSpaceBox.m_max.y / tileSize, 0), tileCountY - 1);
+		extents.tileMin.x = min(max((int)extents.screenSpaceBox.m_min.x / tileSize, 0), tileCountX - 1);
+		extents.tileMin.y = min(max((int)extents.screenSpaceBox.m_min.y / tileSize, 0), tileCountY - 1);
+		extents.tileMax.x = min(max((int)extents.screenSpaceBox.m_max.x / tileSize, 0), tileCountX - 1);
+		extents.tileMax.y = min(max((int)extents.screenSpaceBox.m_max.y / tileSize, 0), tileCountY - 1);
 
-		    // TODO: implement tight light culling instead of simply considering view space bounding box
+		interval.depthExtents = params.depthExtentsCalculator->calculateDepthExtents<UseExponentialSlices>(interval);
+	}
+}
 
-		    interval.depthExtents = depthExtentsCalculator.calculateDepthExtents(interval);
+// Matches LightingKernels::computeLightExtents, slice distances are read through params.depthExtentsCalculator
+static void computeLightExtentsScalar(const LightExtentsParams& params,
+    const float*,
+    const LightSource*                                        lights,
+    LightDepthInterval*                                       inOutIntervals,
+    u32                                                       intervalCount,
+    LightTileScreenSpaceExtents*                              outLightScreenSpaceExtents)
+{
+	dispatchFlags(
+	    [&](auto useExponentialSlices) {
+		    computeLightExtentsScalar<decltype(useExponentialSlices)::value>(
+		        params, lights, inOutIntervals, intervalCount, outLightScreenSpaceExtents);
+	    },
+	    params.depthExtentsCalculator->useExponentialSlices);
+}
 
-#if USE_PARALLEL_ALGORITHMS
-	    });
-#else
+const char* toString(SimdIsa isa)
+{
+	switch (isa)
+	{
+	default: return "unknown";
+	case SimdIsa::Scalar: return "scalar";
+	case SimdIsa::Sse41: return "SSE4.1";
+	case SimdIsa::Avx2: return "AVX2";
+	case SimdIsa::Avx512: return "AVX-512";
 	}
+}
+
+bool isSimdIsaSupported(SimdIsa isa)
+{
+	switch (isa)
+	{
+	default: return false;
+	case SimdIsa::Scalar: return true;
+#if LIGHTCULL_SIMD_KERNELS
+	case SimdIsa::Sse41: return isSse41Supported();
+	case SimdIsa::Avx2: return isAvx2Supported();
+	case SimdIsa::Avx512: return isAvx512Supported();
 #endif
+	}
+}
 
-	u32 totalLightCellCount = 0;
-	for (LightDepthInterval& interval : inOutCulledLights)
+SimdIsa getBestSimdIsa()
+{
+	static const SimdIsa result = []() {
+		for (u32 i = (u32)SimdIsa::count - 1; i != 0; --i)
+		{
+			if (isSimdIsaSupported((SimdIsa)i))
+			{
+				return (SimdIsa)i;
+			}
+		}
+		return SimdIsa::Scalar;
+	}();
+	return result;
+}
+
+static SimdIsa& getActiveSimdIsaRef()
+{
+	static SimdIsa isa = getBestSimdIsa();
+	return isa;
+}
+
+SimdIsa getActiveSimdIsa() { return getActiveSimdIsaRef(); }
+
+void setActiveSimdIsa(SimdIsa isa)
+{
+	RUSH_ASSERT(isSimdIsaSupported(isa));
+	getActiveSimdIsaRef() = isa;
+}
+
+const LightingKernels& getLightingKernels(SimdIsa isa)
+{
+	RUSH_ASSERT(isSimdIsaSupported(isa));
+
+	// Tables are only created once the instruction set is known to be supported, since the compiler may use it anywhere
+	// in the translation units that provide them
+	switch (isa)
 	{
-		const LightTileScreenSpaceExtents& screenSpaceExtents = outLightScreenSpaceExtents[interval.lightIndex];
-		for (u32 z = interval.depthExtents.sliceMin; z <= interval.depthExtents.sliceMax; ++z)
+#if LIGHTCULL_SIMD_KERNELS
+	case SimdIsa::Sse41:
+	{
+		static const LightingKernels kernels = getLightingKernelsSse41();
+		return kernels;
+	}
+	case SimdIsa::Avx2:
+	{
+		static const LightingKernels kernels = getLightingKernelsAvx2();
+		return kernels;
+	}
+	case SimdIsa::Avx512:
+	{
+		static const LightingKernels kernels = getLightingKernelsAvx512();
+		return kernels;
+	}
+#endif
+	default:
+	{
+		// Light extents use the reference implementation, which SIMD kernels are validated against
+		static const LightingKernels kernels = []() {
+			LightingKernels result     = makeLightingKernels<SimdScalar, SimdScalar>();
+			result.computeLightExtents = computeLightExtentsScalar;
+			return result;
+		}();
+		return kernels;
+	}
+	}
+}
+
+void computeLightExtents(SimdIsa isa, const LightExtentsParams& params, const LightSource* lights,
+    LightDepthInterval* inOutIntervals, u32 intervalCount, LightTileScreenSpaceExtents* outLightScreenSpaceExtents)
+{
+	getLightingKernels(isa).computeLightExtents(params, params.depthExtentsCalculator->sliceDistances.data(), lights,
+	    inOutIntervals, intervalCount, outLightScreenSpaceExtents);
+}
+
+// Texels that pixels [pixelBegin, pixelEnd) may sample when a texture is stretched over the screen, rounded outwards
+static u32 getTexelBegin(u32 pixelBegin, u32 pixelCount, u32 texelCount)
+{
+	return u32(u64(pixelBegin) * texelCount / pixelCount);
+}
+
+static u32 getTexelEnd(u32 pixelEnd, u32 pixelCount, u32 texelCount)
+{
+	return min(u32((u64(pixelEnd) * texelCount + pixelCount - 1) / pixelCount), texelCount);
+}
+
+static float getViewSpaceDepth(float depth, float nearZ, float farZ)
+{
+	return nearZ * farZ / (farZ - depth * (farZ - nearZ));
+}
+
+void computeTileDepthRanges(const float* depth, u32 depthWidth, u32 depthHeight, float nearZ, float farZ,
+    Tuple2u resolution, u32 tileSize, std::vector<TileDepthRange>& outTileDepthRanges)
+{
+	const u32 tileCountX = divUp(resolution.x, tileSize);
+	const u32 tileCountY = divUp(resolution.y, tileSize);
+
+	outTileDepthRanges.resize(tileCountX * tileCountY);
+
+	parallelFor<u32>(0, tileCountY, [&](u32 tileY) {
+		const u32 texelBeginY = getTexelBegin(tileY * tileSize, resolution.y, depthHeight);
+		const u32 texelEndY   = getTexelEnd(min((tileY + 1) * tileSize, resolution.y), resolution.y, depthHeight);
+
+		for (u32 tileX = 0; tileX < tileCountX; ++tileX)
 		{
-			for (u32 y = screenSpaceExtents.tileMin.y; y <= screenSpaceExtents.tileMax.y; ++y)
+			const u32 texelBeginX = getTexelBegin(tileX * tileSize, resolution.x, depthWidth);
+			const u32 texelEndX   = getTexelEnd(min((tileX + 1) * tileSize, resolution.x), resolution.x, depthWidth);
+
+			float depthMin = 1.0f;
+			float depthMax = 0.0f;
+			for (u32 y = texelBeginY; y < texelEndY; ++y)
 			{
-				for (u32 x = screenSpaceExtents.tileMin.x; x <= screenSpaceExtents.tileMax.x; ++x)
+				for (u32 x = texelBeginX; x < texelEndX; ++x)
 				{
-					u32 tileIndex = x + y * tileCountX;
-					u32 cellIndex = tileIndex + z * tilesPerSlice;
-					outCellLightCount[cellIndex]++;
+					const float d = depth[x + y * depthWidth];
+					if (d < 1.0f)
+					{
+						depthMin = min(depthMin, d);
+						depthMax = max(depthMax, d);
+					}
 				}
 			}
+
+			TileDepthRange& range = outTileDepthRanges[tileX + tileY * tileCountX];
+
+			if (depthMin > depthMax)
+			{
+				range.depthMin = FLT_MAX;
+				range.depthMax = -FLT_MAX;
+			}
+			else
+			{
+				range.depthMin = getViewSpaceDepth(depthMin, nearZ, farZ);
+				range.depthMax = getViewSpaceDepth(depthMax, nearZ, farZ);
+			}
+		}
+	});
+}
+
+void computeActiveClusterMask(const float* depth, u32 depthWidth, u32 depthHeight, float nearZ, float farZ,
+    const DepthExtentsCalculator& depthExtentsCalculator, Tuple2u resolution, u32 tileSize,
+    std::vector<u32>& outActiveClusterMask)
+{
+	const u32 tileCountX    = divUp(resolution.x, tileSize);
+	const u32 tileCountY    = divUp(resolution.y, tileSize);
+	const u32 tilesPerSlice = tileCountX * tileCountY;
+	const u32 sliceCount    = depthExtentsCalculator.sliceCount;
+	const u32 cellCount     = tilesPerSlice * sliceCount;
+
+	// Cells are flagged in bytes first, so that tile rows can be processed in parallel
+	std::vector<u8> activeCells(cellCount, 0);
+
+	parallelFor<u32>(0, tileCountY, [&](u32 tileY) {
+		const u32 texelBeginY = getTexelBegin(tileY * tileSize, resolution.y, depthHeight);
+		const u32 texelEndY   = getTexelEnd(min((tileY + 1) * tileSize, resolution.y), resolution.y, depthHeight);
+
+		for (u32 tileX = 0; tileX < tileCountX; ++tileX)
+		{
+			const u32 texelBeginX = getTexelBegin(tileX * tileSize, resolution.x, depthWidth);
+			const u32 texelEndX   = getTexelEnd(min((tileX + 1) * tileSize, resolution.x), resolution.x, depthWidth);
+			const u32 tileIndex   = tileX + tileY * tileCountX;
+
+			for (u32 y = texelBeginY; y < texelEndY; ++y)
+			{
+				for (u32 x = texelBeginX; x < texelEndX; ++x)
+				{
+					const float d = depth[x + y * depthWidth];
+					if (d < 1.0f)
+					{
+						const float viewSpaceDepth = getViewSpaceDepth(d, nearZ, farZ);
+						const u32   slice =
+						    depthExtentsCalculator.calculateDepthExtents(viewSpaceDepth, viewSpaceDepth).sliceMin;
+						activeCells[tileIndex + slice * tilesPerSlice] = 1;
+					}
+				}
+			}
+		}
+	});
+
+	// Each mask word is packed by a single task
+	outActiveClusterMask.resize(divUp(cellCount, 32u));
+	parallelFor<u32>(0, (u32)outActiveClusterMask.size(), [&](u32 wordIndex) {
+		const u32 cellBegin = wordIndex * 32;
+		const u32 cellEnd   = min(cellBegin + 32, cellCount);
+
+		u32 word = 0;
+		for (u32 cellIndex = cellBegin; cellIndex < cellEnd; ++cellIndex)
+		{
+			word |= u32(activeCells[cellIndex]) << (cellIndex - cellBegin);
+		}
+
+		outActiveClusterMask[wordIndex] = word;
+	});
+}
+
+void computeLightImportance(const std::vector<LightSource>& lights, const AlignedArray<LightDepthInterval>& intervals,
+    std::vector<float>& outImportance)
+{
+	outImportance.resize(lights.size());
+
+	parallelFor<u32>(0, (u32)intervals.size(), [&](u32 intervalIndex) {
+		const u32 lightIndex      = intervals[intervalIndex].lightIndex;
+		outImportance[lightIndex] = computeLightImportance(lights[lightIndex]);
+	});
+}
+
+TileRowSpanCalculator::TileRowSpanCalculator(const Mat4& matProjScreenSpace, float cameraNearZ, u32 tileSize)
+: m_cameraNearZ(cameraNearZ), m_tileSize(tileSize)
+{
+	const Mat4& m = matProjScreenSpace;
+
+	// Screen space position must be an affine function of (x / z, y / z)
+	m_isPerspective = m.rows[0].w == 0 && m.rows[1].w == 0 && m.rows[2].w != 0 && m.rows[3].w == 0 &&
+	                  m.rows[0].y == 0 && m.rows[1].x == 0 && m.rows[3].x == 0 && m.rows[3].y == 0;
+
+	if (m_isPerspective)
+	{
+		m_screenScale  = Vec2(m.rows[0].x, m.rows[1].y) / m.rows[2].w;
+		m_screenOffset = Vec2(m.rows[2].x, m.rows[2].y) / m.rows[2].w;
+	}
+}
+
+void TileRowSpanCalculator::calculateTileRowSpans(
+    const LightSource& light, const LightTileScreenSpaceExtents& extents, TileRowSpan* outSpans) const
+{
+	const u32 rowCount = 1 + extents.tileMax.y - extents.tileMin.y;
+
+	const Vec3& c = light.position;
+	const float r = light.attenuationEnd;
+
+	if (!m_isPerspective || c.z - r <= m_cameraNearZ)
+	{
+		for (u32 i = 0; i < rowCount; ++i)
+		{
+			outSpans[i] = TileRowSpan{(u16)extents.tileMin.x, (u16)extents.tileMax.x};
+		}
+		return;
+	}
+
+	// Sphere projects to an ellipse in the (u, v) = (x / z, y / z) plane. Direction (u, v, 1) is inside the cone
+	// that touches the sphere if dot(d, c)^2 >= dot(d, d) * (dot(c, c) - r^2), which for a fixed v is a quadratic
+	// inequality a * u^2 + b * u + c >= 0. Since the sphere is in front of the camera, a is always negative.
+
+	const float tSquared = dot(c, c) - sqr(r);
+	const float a        = sqr(c.x) - tSquared;
+
+	// Leftmost and rightmost points of the ellipse are projections of the points where the sphere touches the planes
+	// containing the Y axis. Same as in getBoundsForAxis().
+	const float lengthXZ = sqrtf(sqr(c.x) + sqr(c.z));
+	const float cosTheta = sqrtf(sqr(c.x) + sqr(c.z) - sqr(r)) / lengthXZ;
+	const float sinTheta = r / lengthXZ;
+	const float rightZ   = (c.z * cosTheta - c.x * sinTheta) * cosTheta;
+	const float leftZ    = (c.x * sinTheta + c.z * cosTheta) * cosTheta;
+	const float rightU   = (c.x * cosTheta + c.z * sinTheta) * cosTheta / rightZ;
+	const float leftU    = (c.x * cosTheta - c.z * sinTheta) * cosTheta / leftZ;
+	const float rightV   = c.y / rightZ;
+	const float leftV    = c.y / leftZ;
+
+	// Rows and results are padded by a pixel to stay conservative despite float precision
+	const float padding  = 1.0f;
+	const float tileSize = (float)m_tileSize;
+
+	for (u32 i = 0; i < rowCount; ++i)
+	{
+		const u32 tileY = extents.tileMin.y + i;
+
+		const float v0 = ((tileY * tileSize - padding) - m_screenOffset.y) / m_screenScale.y;
+		const float v1 = (((tileY + 1) * tileSize + padding) - m_screenOffset.y) / m_screenScale.y;
+
+		const float rowMinV = min(v0, v1);
+		const float rowMaxV = max(v0, v1);
+
+		float minU = FLT_MAX;
+		float maxU = -FLT_MAX;
+
+		// Ellipse is convex, so it either crosses one of the row edges or its extreme points are inside the row
+		const float rowEdges[] = {rowMinV, rowMaxV};
+		for (float v : rowEdges)
+		{
+			const float w            = v * c.y + c.z;
+			const float b            = 2.0f * c.x * w;
+			const float discriminant = sqr(b) - 4.0f * a * (sqr(w) - (sqr(v) + 1.0f) * tSquared);
+			if (discriminant >= 0)
+			{
+				const float s = sqrtf(discriminant);
+				minU          = min(minU, (-b + s) / (2.0f * a));
+				maxU          = max(maxU, (-b - s) / (2.0f * a));
+			}
 		}
 
-		u32 lightCellCount = getSliceCount(interval.depthExtents) * getCellCount(screenSpaceExtents);
-		totalLightCellCount += lightCellCount;
+		if (leftV >= rowMinV && leftV <= rowMaxV)
+		{
+			minU = min(minU, leftU);
+		}
+
+		if (rightV >= rowMinV && rightV <= rowMaxV)
+		{
+			maxU = max(maxU, rightU);
+		}
+
+		// Only one extreme point found without crossing any row edge can only be caused by precision issues
+		if (minU == FLT_MAX && maxU != -FLT_MAX)
+		{
+			minU = leftU;
+		}
+		else if (maxU == -FLT_MAX && minU != FLT_MAX)
+		{
+			maxU = rightU;
+		}
+
+		if (minU > maxU)
+		{
+			outSpans[i] = TileRowSpan{1, 0};
+			continue;
+		}
+
+		const float x0 = minU * m_screenScale.x + m_screenOffset.x;
+		const float x1 = maxU * m_screenScale.x + m_screenOffset.x;
+
+		// Clamping to the extents also keeps float to int conversion in range
+		const float extentsMinX = extents.tileMin.x * tileSize;
+		const float extentsMaxX = (extents.tileMax.x + 1) * tileSize - 1.0f;
+
+		const float minX = min(max(min(x0, x1) - padding, extentsMinX), extentsMaxX);
+		const float maxX = min(max(max(x0, x1) + padding, extentsMinX), extentsMaxX);
+
+		outSpans[i] = TileRowSpan{(u16)((u32)minX / m_tileSize), (u16)((u32)maxX / m_tileSize)};
+	}
+}
+
+u32 LightBinning::count(const DepthExtentsCalculator& depthExtentsCalculator, const Mat4& matProjScreenSpace,
+    float cameraNearZ, u32 tileSize, u32 tileCountX, u32 tileCountY, u32 sliceCount,
+    const std::vector<LightSource>& lights, AlignedArray<LightDepthInterval>& inOutCulledLights,
+    LightTileScreenSpaceExtents* outLightScreenSpaceExtents, const TileFrustumCache* tileFrustumCache,
+    const TileDepthRange* tileDepthRanges, const u32* activeCellMask, bool useTileRowSpans, bool useClusterCulling)
+{
+	static constexpr u32 MinChunkSize          = 256;
+	static constexpr u32 ChunksPerThread       = 2;
+	static constexpr u32 CellsPerTask          = 4096;
+	static constexpr u32 MaxChunkSize          = 0xFFFF; // keeps cell counts of a chunk within u16
+	static constexpr u32 MaxHistogramSize      = 32 << 20; // in bytes, for histograms of all chunks
+	static constexpr u32 SuperTileSize         = TileFrustumCache::SuperTileSize;
+	static constexpr u32 MinSuperTileLightArea = 4 * SuperTileSize * SuperTileSize; // in tiles
+
+	const u32 intervalCount = (u32)inOutCulledLights.size();
+	const u32 threadCount   = max(1u, getTaskScheduler()->GetNumTaskThreads());
+
+	const bool useTileFrustumCulling = tileFrustumCache != nullptr;
+	const bool useTileSliceRanges    = tileDepthRanges != nullptr || activeCellMask != nullptr;
+
+	useClusterCulling = useClusterCulling && useTileFrustumCulling;
+
+	// Every chunk clears and merges a histogram of all cells, so large grids get fewer chunks.
+	// Chunking only affects performance, output is the same for any chunk count.
+	m_tileCountX    = tileCountX;
+	m_tilesPerSlice = tileCountX * tileCountY;
+	m_cellCount     = m_tilesPerSlice * sliceCount;
+
+	const u32 histogramChunkCount = max(1u, u32(MaxHistogramSize / (sizeof(u16) * max(1u, m_cellCount))));
+
+	m_chunkCount = min(min(divUp(intervalCount, MinChunkSize), threadCount * ChunksPerThread), histogramChunkCount);
+	m_chunkCount = max(max(m_chunkCount, divUp(intervalCount, MaxChunkSize)), 1u);
+	m_chunkSize  = max(1u, divUp(intervalCount, m_chunkCount));
+
+	m_useTileList         = useTileFrustumCulling || useTileSliceRanges;
+	m_useTileRowSpans     = useTileRowSpans;
+	m_useTileDepthExtents = useClusterCulling || useTileSliceRanges;
+	m_activeCellMask      = activeCellMask;
+
+	m_cellOffsets.resize(m_cellCount + 1);
+	m_chunkCellOffsets.resize(size_t(m_chunkCount) * m_cellCount);
+	m_chunkTiles.resize(m_chunkCount);
+	m_chunkTileDepthExtents.resize(m_chunkCount);
+	m_chunkRowSpans.resize(m_chunkCount);
+	m_intervalTileCounts.resize(m_useTileList ? intervalCount : 0);
+
+	if (useTileSliceRanges)
+	{
+		m_tileSliceRanges.resize(m_tilesPerSlice);
+		parallelFor<u32>(0, m_tilesPerSlice, [&](u32 tileIndex) {
+			LightTileDepthExtents slices = {0, u8(sliceCount - 1)};
+
+			if (tileDepthRanges)
+			{
+				const TileDepthRange& range = tileDepthRanges[tileIndex];
+				if (range.depthMin <= range.depthMax)
+				{
+					slices = depthExtentsCalculator.calculateDepthExtents(range.depthMin, range.depthMax);
+				}
+				else
+				{
+					slices = LightTileDepthExtents{1, 0}; // empty
+				}
+			}
+
+			if (activeCellMask)
+			{
+				while (slices.sliceMin <= slices.sliceMax &&
+				       !isCellActive(activeCellMask, tileIndex + slices.sliceMin * m_tilesPerSlice))
+				{
+					++slices.sliceMin;
+				}
+
+				while (slices.sliceMin < slices.sliceMax &&
+				       !isCellActive(activeCellMask, tileIndex + slices.sliceMax * m_tilesPerSlice))
+				{
+					--slices.sliceMax;
+				}
+
+				if (slices.sliceMin > slices.sliceMax)
+				{
+					slices = LightTileDepthExtents{1, 0};
+				}
+			}
+
+			m_tileSliceRanges[tileIndex] = slices;
+		});
 	}
 
+	LightExtentsParams extentsParams;
+	extentsParams.matProjScreenSpace     = matProjScreenSpace;
+	extentsParams.cameraNearZ            = cameraNearZ;
+	extentsParams.tileSize               = tileSize;
+	extentsParams.tileCountX             = tileCountX;
+	extentsParams.tileCountY             = tileCountY;
+	extentsParams.depthExtentsCalculator = &depthExtentsCalculator;
+
+	const SimdIsa          simdIsa = getActiveSimdIsa();
+	const LightingKernels& kernels = getLightingKernels(simdIsa);
+
+	const TileRowSpanCalculator tileRowSpanCalculator(matProjScreenSpace, cameraNearZ, tileSize);
+
+	const float* sliceDistances = depthExtentsCalculator.sliceDistances.data();
+
+	// Culling options are template parameters of the chunk loop, so that they are not tested per light or tile
+	auto countChunks = [&](auto tileFrustumCullingFlag, auto tileRowSpansFlag, auto clusterCullingFlag,
+	                       auto tileSliceRangesFlag) {
+		constexpr bool UseTileFrustumCulling = decltype(tileFrustumCullingFlag)::value;
+		constexpr bool UseTileRowSpans       = decltype(tileRowSpansFlag)::value;
+		constexpr bool UseClusterCulling     = decltype(clusterCullingFlag)::value;
+		constexpr bool UseTileSliceRanges    = decltype(tileSliceRangesFlag)::value;
+		constexpr bool UseTileList           = UseTileFrustumCulling || UseTileSliceRanges;
+		constexpr bool UseTileDepthExtents   = UseClusterCulling || UseTileSliceRanges;
+
+		parallelFor<u32>(0, m_chunkCount, [&](u32 chunkIndex) {
+			const u32 begin = chunkIndex * m_chunkSize;
+			const u32 end   = min(begin + m_chunkSize, intervalCount);
+
+			u16* cellCounts = &m_chunkCellOffsets[size_t(chunkIndex) * m_cellCount];
+			memset(cellCounts, 0, sizeof(u16) * m_cellCount);
+
+			std::vector<u32>& tiles = m_chunkTiles[chunkIndex];
+			tiles.clear();
+
+			std::vector<LightTileDepthExtents>& tileDepthExtents = m_chunkTileDepthExtents[chunkIndex];
+			tileDepthExtents.clear();
+
+			std::vector<TileRowSpan>& rowSpans = m_chunkRowSpans[chunkIndex];
+			rowSpans.clear();
+
+			std::vector<TileFrustumCache::Coverage> superTileCoverage;
+
+			computeLightExtents(simdIsa, extentsParams, lights.data(), inOutCulledLights.data() + begin,
+			    end - begin, outLightScreenSpaceExtents);
+
+			for (u32 intervalIndex = begin; intervalIndex < end; ++intervalIndex)
+			{
+				const LightDepthInterval&          interval = inOutCulledLights[intervalIndex];
+				const LightSource&                 light    = lights[interval.lightIndex];
+				const LightTileScreenSpaceExtents& extents  = outLightScreenSpaceExtents[interval.lightIndex];
+
+				const Vec4 lightSphere = Vec4(light.position, light.attenuationEnd);
+
+				const TileRowSpan* intervalRowSpans = nullptr;
+				if (UseTileRowSpans)
+				{
+					const size_t rowSpanOffset = rowSpans.size();
+					rowSpans.resize(rowSpanOffset + 1 + extents.tileMax.y - extents.tileMin.y);
+					intervalRowSpans = &rowSpans[rowSpanOffset];
+					tileRowSpanCalculator.calculateTileRowSpans(light, extents, &rowSpans[rowSpanOffset]);
+				}
+
+				// Testing super-tiles first only pays off for lights that cover many of them
+				const u32  tileWidth     = extents.tileMax.x - extents.tileMin.x + 1;
+				const u32  tileHeight    = extents.tileMax.y - extents.tileMin.y + 1;
+				const u32  superTileMinX = extents.tileMin.x / SuperTileSize;
+				const u32  superTileMaxX = extents.tileMax.x / SuperTileSize;
+				const bool useSuperTiles = UseTileFrustumCulling && tileWidth * tileHeight >= MinSuperTileLightArea;
+
+				if (useSuperTiles)
+				{
+					superTileCoverage.resize(superTileMaxX - superTileMinX + 1);
+				}
+
+				u32 tileCount = 0;
+				for (u32 y = extents.tileMin.y; y <= extents.tileMax.y; ++y)
+				{
+					u32 tileMinX = extents.tileMin.x;
+					u32 tileMaxX = extents.tileMax.x;
+					if (UseTileRowSpans)
+					{
+						tileMinX = intervalRowSpans[y - extents.tileMin.y].tileMinX;
+						tileMaxX = intervalRowSpans[y - extents.tileMin.y].tileMaxX;
+					}
+
+					auto addTile = [&](u32 tileIndex, const LightTileDepthExtents& depthExtents) {
+						if (UseTileDepthExtents)
+						{
+							tileDepthExtents.push_back(depthExtents);
+						}
+
+						if (UseTileList)
+						{
+							tiles.push_back(tileIndex);
+							++tileCount;
+						}
+
+						for (u32 z = depthExtents.sliceMin; z <= depthExtents.sliceMax; ++z)
+						{
+							const u32 cellIndex = tileIndex + z * m_tilesPerSlice;
+							if (!UseTileSliceRanges || !activeCellMask || isCellActive(activeCellMask, cellIndex))
+							{
+								cellCounts[cellIndex]++;
+							}
+						}
+					};
+
+					// Skips tiles whose geometry is entirely in front of or behind the light and trims slices to the
+					// ones occupied by geometry
+					auto clipToTileSliceRange = [&](u32 tileIndex, LightTileDepthExtents& depthExtents) {
+						if (tileDepthRanges)
+						{
+							const TileDepthRange& range = tileDepthRanges[tileIndex];
+							if (interval.center + interval.radius < range.depthMin ||
+							    interval.center - interval.radius > range.depthMax)
+							{
+								return false;
+							}
+						}
+
+						const LightTileDepthExtents& tileSlices = m_tileSliceRanges[tileIndex];
+
+						depthExtents.sliceMin = max(depthExtents.sliceMin, tileSlices.sliceMin);
+						depthExtents.sliceMax = min(depthExtents.sliceMax, tileSlices.sliceMax);
+
+						return depthExtents.sliceMin <= depthExtents.sliceMax;
+					};
+
+					if (UseTileFrustumCulling)
+					{
+						auto addVisibleTile = [&](u32 tileIndex) {
+							LightTileDepthExtents depthExtents = interval.depthExtents;
+
+							if (UseTileSliceRanges && !clipToTileSliceRange(tileIndex, depthExtents))
+							{
+								return;
+							}
+
+							// Lights within a single slice were already tested against the tile frustum, which is
+							// tighter than the bounding box of the cluster
+							if (UseClusterCulling && interval.depthExtents.sliceMin != interval.depthExtents.sliceMax &&
+							    !tileFrustumCache->cullSlices(tileIndex, lightSphere, sliceDistances, depthExtents))
+							{
+								return;
+							}
+
+							addTile(tileIndex, depthExtents);
+						};
+
+						auto testTiles = [&](u32 firstX, u32 lastX) {
+							for (u32 x = firstX; x <= lastX; x += TileFrustumCache::GroupSize)
+							{
+								const u32 firstTileIndex = x + y * tileCountX;
+								const u32 groupTileCount = min(lastX + 1 - x, TileFrustumCache::GroupSize);
+
+								u32 mask =
+								    kernels.testTileFrustumSphereGroup(*tileFrustumCache, firstTileIndex, lightSphere);
+								mask &= (1u << groupTileCount) - 1;
+
+								while (mask)
+								{
+									addVisibleTile(firstTileIndex + findFirstSetBit(mask));
+									mask &= mask - 1;
+								}
+							}
+						};
+
+						if (useSuperTiles)
+						{
+							const u32 superTileY = y / SuperTileSize;
+							if (y == extents.tileMin.y || y % SuperTileSize == 0)
+							{
+								for (u32 superTileX = superTileMinX; superTileX <= superTileMaxX; ++superTileX)
+								{
+									superTileCoverage[superTileX - superTileMinX] =
+									    tileFrustumCache->getSuperTileCoverage(superTileX, superTileY, lightSphere);
+								}
+							}
+
+							for (u32 x = tileMinX; x <= tileMaxX;)
+							{
+								const u32 superTileX = x / SuperTileSize;
+								const u32 lastX      = min(tileMaxX, superTileX * SuperTileSize + SuperTileSize - 1);
+
+								switch (superTileCoverage[superTileX - superTileMinX])
+								{
+								case TileFrustumCache::Coverage::None: break;
+								case TileFrustumCache::Coverage::Partial: testTiles(x, lastX); break;
+								case TileFrustumCache::Coverage::Full:
+									for (u32 i = x; i <= lastX; ++i)
+									{
+										addVisibleTile(i + y * tileCountX);
+									}
+									break;
+								}
+
+								x = lastX + 1;
+							}
+						}
+						else
+						{
+							testTiles(tileMinX, tileMaxX);
+						}
+					}
+					else
+					{
+						for (u32 x = tileMinX; x <= tileMaxX; ++x)
+						{
+							const u32 tileIndex = x + y * tileCountX;
+
+							LightTileDepthExtents depthExtents = interval.depthExtents;
+							if (!UseTileSliceRanges || clipToTileSliceRange(tileIndex, depthExtents))
+							{
+								addTile(tileIndex, depthExtents);
+							}
+						}
+					}
+				}
+
+				if (UseTileList)
+				{
+					m_intervalTileCounts[intervalIndex] = tileCount;
+				}
+			}
+		});
+	};
+
+	dispatchFlags(countChunks, useTileFrustumCulling, useTileRowSpans, useClusterCulling, useTileSliceRanges);
+
+	// Merge chunk histograms. Chunk counts are replaced with offsets within the cell and cell totals are then turned
+	// into global cell offsets.
+
+	const u32 mergeTaskCount = divUp(m_cellCount, CellsPerTask);
+
+	parallelFor<u32>(0, mergeTaskCount, [&](u32 taskIndex) {
+		const u32 begin = taskIndex * CellsPerTask;
+		const u32 end   = min(begin + CellsPerTask, m_cellCount);
+
+		u32* cellCounts = &m_cellOffsets[begin];
+		memset(cellCounts, 0, sizeof(u32) * (end - begin));
+
+		for (u32 chunkIndex = 0; chunkIndex < m_chunkCount; ++chunkIndex)
+		{
+			u16* chunkCellOffsets = &m_chunkCellOffsets[size_t(chunkIndex) * m_cellCount];
+			for (u32 cellIndex = begin; cellIndex < end; ++cellIndex)
+			{
+				const u16 chunkCellCount    = chunkCellOffsets[cellIndex];
+				chunkCellOffsets[cellIndex] = (u16)cellCounts[cellIndex - begin];
+				cellCounts[cellIndex - begin] += chunkCellCount;
+			}
+		}
+	});
+
+	const u32 totalLightCellCount = parallelExclusiveScan(m_cellOffsets.data(), m_cellCount, CellsPerTask);
+
+	m_cellOffsets[m_cellCount] = totalLightCellCount;
+
 	return totalLightCellCount;
 }
 
@@ -183,17 +882,34 @@ u32 performLightCullingAndComputeDepthIntervals(const Frustum& frustum,
     AlignedArray<u32>&                                         outIndices,
     AlignedArray<LightDepthInterval>&                          outLightIntervals)
 {
-	outIndices.resize(viewSpaceLights.size());
-	outLightIntervals.resize(viewSpaceLights.size());
+	static constexpr u32 LightsPerTask = 128;
 
-	u32 outputCount = 0;
+	const u32 lightCount = (u32)viewSpaceLights.size();
 
-	parallelForEach(viewSpaceLights.begin(), viewSpaceLights.end(), [&](const LightSource& light) {
-		if (frustum.intersectSphereConservative(light.position, light.attenuationEnd))
+	outIndices.resize(lightCount);
+	outLightIntervals.resize(lightCount);
+
+	auto isVisible = [&](const LightSource& light) {
+		return frustum.intersectSphereConservative(light.position, light.attenuationEnd);
+	};
+
+	auto countVisibleLights = [&](u32 begin, u32 end) {
+		u32 visibleCount = 0;
+		for (u32 lightIndex = begin; lightIndex < end; ++lightIndex)
 		{
-			u64 lightIndex = &light - viewSpaceLights.data();
+			visibleCount += isVisible(viewSpaceLights[lightIndex]) ? 1 : 0;
+		}
+		return visibleCount;
+	};
 
-			u32 writeIndex = interlockedIncrement(outputCount) - 1;
+	auto writeVisibleLights = [&](u32 begin, u32 end, u32 writeIndex) {
+		for (u32 lightIndex = begin; lightIndex < end; ++lightIndex)
+		{
+			const LightSource& light = viewSpaceLights[lightIndex];
+			if (!isVisible(light))
+			{
+				continue;
+			}
 
 			outIndices[writeIndex] = (u16)lightIndex;
 
@@ -201,8 +917,152 @@ u32 performLightCullingAndComputeDepthIntervals(const Frustum& frustum,
 			interval.radius              = light.attenuationEnd;
 			interval.center              = light.position.z;
 			interval.lightIndex          = (u16)lightIndex;
+
+			++writeIndex;
 		}
+	};
+
+	const u32 outputCount = parallelCompact(lightCount, LightsPerTask, countVisibleLights, writeVisibleLights);
+
+	outIndices.m_count        = outputCount;
+	outLightIntervals.m_count = outputCount;
+
+	return outputCount;
+}
+
+void LightSpheresSoA::resize(u32 lightCount)
+{
+	const u32 paddedCount = divUp(lightCount, GroupSize) * GroupSize;
+
+	// 32 byte alignment allows full group loads with AVX
+	x.resize(paddedCount, 32);
+	y.resize(paddedCount, 32);
+	z.resize(paddedCount, 32);
+	r.resize(paddedCount, 32);
+
+	m_count = lightCount;
+
+	for (u32 i = lightCount; i < paddedCount; ++i)
+	{
+		x[i] = 0.0f;
+		y[i] = 0.0f;
+		z[i] = 0.0f;
+		r[i] = 0.0f;
+	}
+}
+
+void LightSpheresSoA::build(const std::vector<LightSource>& lights)
+{
+	const u32 lightCount = (u32)lights.size();
+
+	resize(lightCount);
+
+	parallelFor<u32>(0, lightCount, [&](u32 i) {
+		const LightSource& light = lights[i];
+		x[i]                     = light.position.x;
+		y[i]                     = light.position.y;
+		z[i]                     = light.position.z;
+		r[i]                     = light.attenuationEnd;
 	});
+}
+
+inline Vec4 getMatrixColumn(const Mat4& m, u32 i)
+{
+	return Vec4((&m.rows[0].x)[i], (&m.rows[1].x)[i], (&m.rows[2].x)[i], (&m.rows[3].x)[i]);
+}
+
+FrustumPlanes::FrustumPlanes(const Mat4& matProj)
+{
+	const Vec4 column0 = getMatrixColumn(matProj, 0);
+	const Vec4 column1 = getMatrixColumn(matProj, 1);
+	const Vec4 column2 = getMatrixColumn(matProj, 2);
+	const Vec4 column3 = getMatrixColumn(matProj, 3);
+
+	planes[Left]   = column3 + column0;
+	planes[Right]  = column3 - column0;
+	planes[Bottom] = column3 + column1;
+	planes[Top]    = column3 - column1;
+
+	// Near plane assumes [-1, 1] clip space depth range, which is conservative when [0, 1] range is used
+	planes[Near] = column3 + column2;
+	planes[Far]  = column3 - column2;
+
+	for (Vec4& plane : planes)
+	{
+		const float planeNormalLength = length(plane.xyz());
+		if (planeNormalLength > 1e-6f)
+		{
+			plane = plane * (1.0f / planeNormalLength);
+		}
+		else
+		{
+			// Degenerate plane, i.e. far plane of an infinite projection. Never reject anything.
+			plane = Vec4(0.0f, 0.0f, 0.0f, FLT_MAX);
+		}
+	}
+}
+
+u32 performLightCullingAndComputeDepthIntervals(const FrustumPlanes& frustum,
+    const LightSpheresSoA&                                         lightSpheres,
+    AlignedArray<u32>&                                             outIndices,
+    AlignedArray<LightDepthInterval>&                              outLightIntervals)
+{
+	static constexpr u32 GroupSize     = LightSpheresSoA::GroupSize;
+	static constexpr u32 GroupsPerTask = 16;
+
+	const u32 lightCount = (u32)lightSpheres.size();
+	const u32 groupCount = divUp(lightCount, GroupSize);
+
+	outIndices.resize(lightCount);
+	outLightIntervals.resize(lightCount);
+
+	const LightingKernels& kernels = getActiveLightingKernels();
+
+	auto getVisibilityMask = [&](u32 groupIndex) {
+		const u32 groupBegin = groupIndex * GroupSize;
+		const u32 laneCount  = lightCount - groupBegin;
+		u32       mask = kernels.testLightSphereGroup(frustum, &lightSpheres.x[groupBegin], &lightSpheres.y[groupBegin],
+		    &lightSpheres.z[groupBegin], &lightSpheres.r[groupBegin]);
+		if (laneCount < GroupSize)
+		{
+			mask &= (1u << laneCount) - 1;
+		}
+		return mask;
+	};
+
+	// The culling kernel is cheap enough to run again in the scatter pass instead of storing visibility masks
+
+	auto countVisibleLights = [&](u32 groupBegin, u32 groupEnd) {
+		u32 visibleCount = 0;
+		for (u32 groupIndex = groupBegin; groupIndex < groupEnd; ++groupIndex)
+		{
+			visibleCount += bitCount(getVisibilityMask(groupIndex));
+		}
+		return visibleCount;
+	};
+
+	auto writeVisibleLights = [&](u32 groupBegin, u32 groupEnd, u32 writeIndex) {
+		for (u32 groupIndex = groupBegin; groupIndex < groupEnd; ++groupIndex)
+		{
+			u32 mask = getVisibilityMask(groupIndex);
+			while (mask)
+			{
+				const u32 lightIndex = groupIndex * GroupSize + findFirstSetBit(mask);
+				mask &= mask - 1;
+
+				outIndices[writeIndex] = lightIndex;
+
+				LightDepthInterval& interval = outLightIntervals[writeIndex];
+				interval.radius              = lightSpheres.r[lightIndex];
+				interval.center              = lightSpheres.z[lightIndex];
+				interval.lightIndex          = (u16)lightIndex;
+
+				++writeIndex;
+			}
+		}
+	};
+
+	const u32 outputCount = parallelCompact(groupCount, GroupsPerTask, countVisibleLights, writeVisibleLights);
 
 	outIndices.m_count        = outputCount;
 	outLightIntervals.m_count = outputCount;
@@ -210,6 +1070,154 @@ u32 performLightCullingAndComputeDepthIntervals(const Frustum& frustum,
 	return outputCount;
 }
 
+inline void writeViewSpaceLight(const LightSource& light, const Vec3& viewSpacePosition, u32 writeIndex,
+    LightDepthInterval& outInterval, LightSource& outViewSpaceLight)
+{
+	outViewSpaceLight          = light;
+	outViewSpaceLight.position = viewSpacePosition;
+
+	outInterval.radius     = outViewSpaceLight.attenuationEnd;
+	outInterval.center     = outViewSpaceLight.position.z;
+	outInterval.lightIndex = (u16)writeIndex;
+}
+
+struct alignas(32) LightSphereGroup
+{
+	float x[LightSpheresSoA::GroupSize];
+	float y[LightSpheresSoA::GroupSize];
+	float z[LightSpheresSoA::GroupSize];
+	float r[LightSpheresSoA::GroupSize];
+};
+
+u32 performLightCullingAndTransform(const FrustumPlanes& worldSpaceFrustum,
+    const Mat4&                                          matView,
+    const AnimatedLightSource*                           lights,
+    u32                                                  lightCount,
+    AlignedArray<u32>&                                   outIndices,
+    AlignedArray<LightDepthInterval>&                    outLightIntervals,
+    std::vector<LightSource>&                            outVisibleLights)
+{
+	static constexpr u32 GroupSize     = LightSpheresSoA::GroupSize;
+	static constexpr u32 GroupsPerTask = 16;
+
+	static_assert(GroupSize <= 8, "Visibility masks of groups are stored in bytes");
+
+	const u32 groupCount = divUp(lightCount, GroupSize);
+
+	const LightingKernels& kernels = getActiveLightingKernels();
+
+	auto gatherGroup = [&](u32 groupIndex, LightSphereGroup& group) {
+		const u32 groupBegin = groupIndex * GroupSize;
+		const u32 laneCount  = min(lightCount - groupBegin, GroupSize);
+
+		group = {};
+		for (u32 lane = 0; lane < laneCount; ++lane)
+		{
+			const LightSource& light = lights[groupBegin + lane];
+			group.x[lane]            = light.position.x;
+			group.y[lane]            = light.position.y;
+			group.z[lane]            = light.position.z;
+			group.r[lane]            = light.attenuationEnd;
+		}
+
+		return laneCount;
+	};
+
+	// Visibility masks of the count pass are kept, so that the write pass only revisits groups with visible lights
+	std::vector<u8> groupMasks(groupCount);
+
+	auto countVisibleLights = [&](u32 groupBegin, u32 groupEnd) {
+		u32 visibleCount = 0;
+		for (u32 groupIndex = groupBegin; groupIndex < groupEnd; ++groupIndex)
+		{
+			LightSphereGroup group;
+
+			const u32 laneCount = gatherGroup(groupIndex, group);
+
+			u32 mask = kernels.testLightSphereGroup(worldSpaceFrustum, group.x, group.y, group.z, group.r);
+			if (laneCount < GroupSize)
+			{
+				mask &= (1u << laneCount) - 1;
+			}
+
+			groupMasks[groupIndex] = (u8)mask;
+			visibleCount += bitCount(mask);
+		}
+		return visibleCount;
+	};
+
+	// View space data is only produced for lights that pass the world space frustum test.
+	// Positions of the whole group are transformed at once from a structure-of-arrays copy.
+
+	auto writeVisibleLights = [&](u32 groupBegin, u32 groupEnd, u32 writeIndex) {
+		for (u32 groupIndex = groupBegin; groupIndex < groupEnd; ++groupIndex)
+		{
+			u32 mask = groupMasks[groupIndex];
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			LightSphereGroup group;
+			gatherGroup(groupIndex, group);
+
+			kernels.transformPoints(matView, group.x, group.y, group.z, group.x, group.y, group.z, GroupSize);
+
+			while (mask)
+			{
+				const u32 lane       = findFirstSetBit(mask);
+				const u32 lightIndex = groupIndex * GroupSize + lane;
+				mask &= mask - 1;
+
+				outIndices[writeIndex] = lightIndex;
+				writeViewSpaceLight(lights[lightIndex], Vec3(group.x[lane], group.y[lane], group.z[lane]), writeIndex,
+				    outLightIntervals[writeIndex], outVisibleLights[writeIndex]);
+
+				++writeIndex;
+			}
+		}
+	};
+
+	// Same as parallelCompact(), except that outputs are resized between the passes. Growing outVisibleLights to the
+	// number of visible lights only initializes entries that are about to be written.
+
+	const ChunkedRange chunks(groupCount, GroupsPerTask);
+
+	u32 chunkOffsets[ChunkedRange::MaxChunkCount];
+
+	chunks.forEachChunk(
+	    [&](u32 chunkIndex, u32 begin, u32 end) { chunkOffsets[chunkIndex] = countVisibleLights(begin, end); });
+
+	const u32 outputCount = chunks.scanChunkValues(chunkOffsets);
+
+	outIndices.resize(outputCount);
+	outLightIntervals.resize(outputCount);
+	outVisibleLights.resize(outputCount);
+
+	chunks.forEachChunk(
+	    [&](u32 chunkIndex, u32 begin, u32 end) { writeVisibleLights(begin, end, chunkOffsets[chunkIndex]); });
+
+	return outputCount;
+}
+
+void transformVisibleLights(const Mat4& matView,
+    const AnimatedLightSource*          lights,
+    const AlignedArray<u32>&            visibleLightIndices,
+    AlignedArray<LightDepthInterval>&   outLightIntervals,
+    std::vector<LightSource>&           outVisibleLights)
+{
+	const u32 visibleCount = (u32)visibleLightIndices.size();
+
+	outLightIntervals.resize(visibleCount);
+	outVisibleLights.resize(visibleCount);
+
+	parallelFor<u32>(0, visibleCount, [&](u32 i) {
+		const LightSource& light = lights[visibleLightIndices[i]];
+		writeViewSpaceLight(
+		    light, transformPoint(matView, light.position), i, outLightIntervals[i], outVisibleLights[i]);
+	});
+}
+
 const char* toString(LightingMode mode)
 {
 	switch (mode)
@@ -242,10 +1250,17 @@ void TileFrustumCache::build(float fov, float aspect, u32 tileSize, u32 tileCoun
 	m_tileCountY          = tileCountY;
 	m_resolutionX         = resolutionX;
 
-	u32 tileCount = tileCountX * tileCountY;
+	const u32 tileCount   = tileCountX * tileCountY;
+	const u32 paddedCount = tileCount + GroupSize - 1;
 
-	m_corners.resize(tileCount * 4);
-	m_planes.resize(tileCount * 4);
+	AlignedArray<float>* arrays[] = {&m_cornerLeftX, &m_cornerRightX, &m_cornerTopY, &m_cornerBottomY, &m_leftPlaneX,
+	    &m_leftPlaneZ, &m_topPlaneY, &m_topPlaneZ, &m_rightPlaneX, &m_rightPlaneZ, &m_bottomPlaneY, &m_bottomPlaneZ};
+
+	for (AlignedArray<float>* array : arrays)
+	{
+		array->resize(paddedCount, 32);
+		memset(array->data(), 0, sizeof(float) * paddedCount);
+	}
 
 	for (u32 y = 0; y < tileCountY; ++y)
 	{
@@ -253,8 +1268,142 @@ void TileFrustumCache::build(float fov, float aspect, u32 tileSize, u32 tileCoun
 		{
 			const Vec2 tileTopLeft = Vec2(float(x), float(y));
 			u32        tileId      = x + y * tileCountX;
-			computeTileFrustumParameters(
-			    cameraFrustumTopLeftCorner, tileStep, tileTopLeft, &m_corners[tileId * 4], &m_planes[tileId * 4]);
+
+			Vec3 corners[4];
+			Vec3 planes[4];
+			computeTileFrustumParameters(cameraFrustumTopLeftCorner, tileStep, tileTopLeft, corners, planes);
+
+			m_cornerLeftX[tileId]   = corners[0].x;
+			m_cornerRightX[tileId]  = corners[1].x;
+			m_cornerTopY[tileId]    = corners[0].y;
+			m_cornerBottomY[tileId] = corners[2].y;
+
+			m_leftPlaneX[tileId]   = planes[0].x;
+			m_leftPlaneZ[tileId]   = planes[0].z;
+			m_topPlaneY[tileId]    = planes[1].y;
+			m_topPlaneZ[tileId]    = planes[1].z;
+			m_rightPlaneX[tileId]  = planes[2].x;
+			m_rightPlaneZ[tileId]  = planes[2].z;
+			m_bottomPlaneY[tileId] = planes[3].y;
+			m_bottomPlaneZ[tileId] = planes[3].z;
+		}
+	}
+
+	m_superTileCountX = divUp(tileCountX, SuperTileSize);
+	m_superTileCountY = divUp(tileCountY, SuperTileSize);
+
+	m_superTileCornerRays.resize(m_superTileCountX * m_superTileCountY * 4);
+	m_superTileSidePlanes.resize(m_superTileCountX * m_superTileCountY * 4);
+
+	for (u32 y = 0; y < m_superTileCountY; ++y)
+	{
+		for (u32 x = 0; x < m_superTileCountX; ++x)
+		{
+			// Super-tiles on the right and bottom edges only cover the remaining tiles
+			const Vec2 tileTopLeft     = Vec2(float(x * SuperTileSize), float(y * SuperTileSize));
+			const Vec2 tileBottomRight = Vec2(float(min((x + 1) * SuperTileSize, tileCountX)),
+			    float(min((y + 1) * SuperTileSize, tileCountY)));
+			const u32  superTileId     = x + y * m_superTileCountX;
+
+			computeTileFrustumParameters(cameraFrustumTopLeftCorner, tileStep, tileTopLeft, tileBottomRight,
+			    &m_superTileCornerRays[superTileId * 4], &m_superTileSidePlanes[superTileId * 4]);
 		}
 	}
 }
+
+void TileFrustumCache::getTileFrustum(u32 tileIndex, Vec3 outFrustumCornerRays[4], Vec3 outFrustumSidePlanes[4]) const
+{
+	const u32 i = tileIndex;
+
+	outFrustumCornerRays[0] = Vec3(m_cornerLeftX[i], m_cornerTopY[i], 1);
+	outFrustumCornerRays[1] = Vec3(m_cornerRightX[i], m_cornerTopY[i], 1);
+	outFrustumCornerRays[2] = Vec3(m_cornerLeftX[i], m_cornerBottomY[i], 1);
+	outFrustumCornerRays[3] = Vec3(m_cornerRightX[i], m_cornerBottomY[i], 1);
+
+	outFrustumSidePlanes[0] = Vec3(m_leftPlaneX[i], 0, m_leftPlaneZ[i]);
+	outFrustumSidePlanes[1] = Vec3(0, m_topPlaneY[i], m_topPlaneZ[i]);
+	outFrustumSidePlanes[2] = Vec3(m_rightPlaneX[i], 0, m_rightPlaneZ[i]);
+	outFrustumSidePlanes[3] = Vec3(0, m_bottomPlaneY[i], m_bottomPlaneZ[i]);
+}
+
+bool TileFrustumCache::cullSlices(
+    u32 tileIndex, const Vec4& sphere, const float* sliceDistances, LightTileDepthExtents& inOutDepthExtents) const
+{
+	// Tile corner rays are at z = 1, so cluster corners are the rays scaled by slice distances
+	const float leftX   = m_cornerLeftX[tileIndex];
+	const float rightX  = m_cornerRightX[tileIndex];
+	const float topY    = m_cornerTopY[tileIndex];
+	const float bottomY = m_cornerBottomY[tileIndex];
+
+	const float r2 = sphere.w * sphere.w;
+
+	auto testSlice = [&](u32 sliceIndex) {
+		// Clipping the cluster to the depth range of the sphere keeps the box conservative and also bounds the last
+		// slice, which extends to infinity
+		const float nearZ = max(sliceIndex == 0 ? 0.0f : sliceDistances[sliceIndex - 1], sphere.z - sphere.w);
+		const float farZ  = min(sliceDistances[sliceIndex], sphere.z + sphere.w);
+
+		const float minX = min(leftX * nearZ, leftX * farZ);
+		const float maxX = max(rightX * nearZ, rightX * farZ);
+		const float minY = min(min(topY * nearZ, topY * farZ), min(bottomY * nearZ, bottomY * farZ));
+		const float maxY = max(max(topY * nearZ, topY * farZ), max(bottomY * nearZ, bottomY * farZ));
+
+		const float dx = max(max(minX - sphere.x, sphere.x - maxX), 0.0f);
+		const float dy = max(max(minY - sphere.y, sphere.y - maxY), 0.0f);
+		const float dz = max(max(nearZ - sphere.z, sphere.z - farZ), 0.0f);
+
+		return dx * dx + dy * dy + dz * dz <= r2;
+	};
+
+	u32 sliceMin = inOutDepthExtents.sliceMin;
+	u32 sliceMax = inOutDepthExtents.sliceMax;
+
+	while (sliceMin <= sliceMax && !testSlice(sliceMin))
+	{
+		++sliceMin;
+	}
+
+	if (sliceMin > sliceMax)
+	{
+		return false;
+	}
+
+	while (sliceMax > sliceMin && !testSlice(sliceMax))
+	{
+		--sliceMax;
+	}
+
+	inOutDepthExtents.sliceMin = (u8)sliceMin;
+	inOutDepthExtents.sliceMax = (u8)sliceMax;
+
+	return true;
+}
+
+TileFrustumCache::Coverage TileFrustumCache::getSuperTileCoverage(
+    u32 superTileX, u32 superTileY, const Vec4& sphere) const
+{
+	const u32   superTileId = superTileX + superTileY * m_superTileCountX;
+	const Vec3* cornerRays  = &m_superTileCornerRays[superTileId * 4];
+	const Vec3* sidePlanes  = &m_superTileSidePlanes[superTileId * 4];
+
+	if (!testTileFrustumSphere(cornerRays, sidePlanes, sphere))
+	{
+		return Coverage::None;
+	}
+
+	// Rays from the origin that hit the sphere form a convex cone, so the whole super-tile is inside of it if all
+	// corner rays are
+	const float r2 = sphere.w * sphere.w;
+	for (u32 i = 0; i < 4; ++i)
+	{
+		const Vec3& ray = cornerRays[i];
+		const Vec3  a   = ray * max(0.0f, dot(sphere.xyz(), ray)) / dot(ray, ray);
+		const Vec3  b   = sphere.xyz() - a;
+		if (dot(b, b) >= r2)
+		{
+			return Coverage::Partial;
+		}
+	}
+
+	return Coverage::Full;
+}
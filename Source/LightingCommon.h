@@ -70,16 +70,37 @@ inline u32 getCellCount(const LightTileScreenSpaceExtents& extents)
 	return x * y;
 }
 
+// View space depth range of the geometry in a screen space tile. Tiles without geometry have depthMin > depthMax.
+struct TileDepthRange
+{
+	float depthMin;
+	float depthMax;
+};
+
+class OcclusionBuffer;
+
 struct CommonLightBuildParams
 {
 	Tuple2u resolution = Tuple2u({1, 1});
 	u32     tileSize   = 1;
 
+	// Optional depth range of each tile of the resolution in row order, e.g. from computeTileDepthRanges().
+	// Lights are not assigned to cells outside of the range of their tile. Must stay valid while building.
+	const TileDepthRange* tileDepthRanges = nullptr;
+
+	// Optional occluder depth rendered with the same camera. Lights hidden behind occluders are not binned.
+	const OcclusionBuffer* occlusionBuffer = nullptr;
+
 	u32                    sliceCount            = 16;
 	static constexpr float minSliceDepth         = 5.0f;
 	float                  maxSliceDepth         = 500.0f;
 	bool                   useExponentialSlices  = false;
 	bool                   useTileFrustumCulling = true;
+	bool                   useTileRowSpans       = true; // bin lights into exact tile spans of the projected sphere
+
+	// Cells that would get more lights than this only keep the most important ones (see computeLightImportance()).
+	// This bounds the cost of the most crowded cells at the expense of dropping their dimmest or most distant lights.
+	u32 maxLightsPerCell = 0; // no limit if 0
 
 	bool calculateTileLightCount = true;
 };
@@ -349,6 +370,28 @@ inline void computeTileFrustumParameters(const Vec2& cameraTopLeftCornerRay,
 	outFrustumSidePlanes[3] = normalize(cross(outFrustumCornerRays[2], outFrustumCornerRays[3]));
 }
 
+// Same as above, but for a frustum that covers a rectangle of tiles
+inline void computeTileFrustumParameters(const Vec2& cameraTopLeftCornerRay,
+    const Vec2&                                      tileStep,
+    const Vec2&                                      tileTopLeft,
+    const Vec2&                                      tileBottomRight,
+    Vec3 outFrustumCornerRays[4], // unnormalized vectors to frustum corners (TL, TR, BL, BR)
+    Vec3 outFrustumSidePlanes[4]) // left, top, right, bottom
+{
+	const Vec2& tl = tileTopLeft;
+	const Vec2& br = tileBottomRight;
+
+	outFrustumCornerRays[0] = makeVec3(cameraTopLeftCornerRay + Vec2(tileStep * Vec2(tl.x, tl.y)), 1);
+	outFrustumCornerRays[1] = makeVec3(cameraTopLeftCornerRay + Vec2(tileStep * Vec2(br.x, tl.y)), 1);
+	outFrustumCornerRays[2] = makeVec3(cameraTopLeftCornerRay + Vec2(tileStep * Vec2(tl.x, br.y)), 1);
+	outFrustumCornerRays[3] = makeVec3(cameraTopLeftCornerRay + Vec2(tileStep * Vec2(br.x, br.y)), 1);
+
+	outFrustumSidePlanes[0] = normalize(cross(outFrustumCornerRays[0], outFrustumCornerRays[2]));
+	outFrustumSidePlanes[1] = normalize(cross(outFrustumCornerRays[1], outFrustumCornerRays[0]));
+	outFrustumSidePlanes[2] = normalize(cross(outFrustumCornerRays[3], outFrustumCornerRays[1]));
+	outFrustumSidePlanes[3] = normalize(cross(outFrustumCornerRays[2], outFrustumCornerRays[3]));
+}
+
 inline bool testTileFrustumSphere(
     const Vec2& cameraFrustumTopLeft, const Vec2& tileStep, const Vec2& tileTopLeft, const Vec4 sphere)
 {
@@ -385,12 +428,32 @@ struct DepthExtentsCalculator
 
 	inline LightTileDepthExtents calculateDepthExtents(const LightDepthInterval& interval) const
 	{
-		float depthMin = max(interval.center - interval.radius, 0.0f);
-		float depthMax = min(interval.center + interval.radius, maxSliceDepth);
+		return useExponentialSlices ? calculateDepthExtents<true>(interval) : calculateDepthExtents<false>(interval);
+	}
+
+	inline LightTileDepthExtents calculateDepthExtents(float depthMin, float depthMax) const
+	{
+		return useExponentialSlices ? calculateDepthExtents<true>(depthMin, depthMax)
+		                            : calculateDepthExtents<false>(depthMin, depthMax);
+	}
+
+	// Same as above, with slice distribution resolved at compile time for use in loops over many lights
+	template <bool UseExponentialSlices>
+	inline LightTileDepthExtents calculateDepthExtents(const LightDepthInterval& interval) const
+	{
+		return calculateDepthExtents<UseExponentialSlices>(
+		    interval.center - interval.radius, interval.center + interval.radius);
+	}
+
+	template <bool UseExponentialSlices>
+	inline LightTileDepthExtents calculateDepthExtents(float depthMin, float depthMax) const
+	{
+		depthMin = max(depthMin, 0.0f);
+		depthMax = min(depthMax, maxSliceDepth);
 
 		LightTileDepthExtents result;
 
-		if (useExponentialSlices)
+		if (UseExponentialSlices)
 		{
 #if 0
 			float logDepthMin = log2f(depthMin);
@@ -424,12 +487,98 @@ struct DepthExtentsCalculator
 	const bool useExponentialSlices;
 };
 
+// Computes view space depth range of each tile from a depth buffer with values in [0, 1] from near to far plane of a
+// perspective projection. Depth buffer is stretched over the tile grid of the given resolution, as a full screen pass
+// would sample it, and pixels at the far plane are treated as empty.
+void computeTileDepthRanges(const float* depth,
+    u32                                  depthWidth,
+    u32                                  depthHeight,
+    float                                nearZ,
+    float                                farZ,
+    Tuple2u                              resolution,
+    u32                                  tileSize,
+    std::vector<TileDepthRange>&         outTileDepthRanges);
+
+// Marks light grid cells that contain at least one pixel of the depth buffer, which is interpreted the same way as in
+// computeTileDepthRanges(). Bit (cellIndex % 32) of word (cellIndex / 32) is set for active cells, where cell index is
+// tileIndex + sliceIndex * tilesPerSlice.
+void computeActiveClusterMask(const float* depth,
+    u32                                    depthWidth,
+    u32                                    depthHeight,
+    float                                  nearZ,
+    float                                  farZ,
+    const DepthExtentsCalculator&          depthExtentsCalculator,
+    Tuple2u                                resolution,
+    u32                                    tileSize,
+    std::vector<u32>&                      outActiveClusterMask);
+
+inline bool isCellActive(const u32* activeCellMask, u32 cellIndex)
+{
+	return (activeCellMask[cellIndex / 32] >> (cellIndex % 32)) & 1;
+}
+
+// Rough measure of how much a view space light contributes to the image: its average intensity, scaled by the solid
+// angle that its sphere of influence covers as seen from the camera.
+inline float computeLightImportance(const LightSource& light)
+{
+	const float intensity = dot(light.intensity, Vec3(1.0f / 3.0f));
+	const float distance  = max(light.position.length(), light.attenuationEnd);
+	const float size      = light.attenuationEnd / distance;
+	return intensity * size * size;
+}
+
+// Computes importance of the lights of all intervals. Output is indexed by light index, same as lights.
+void computeLightImportance(const std::vector<LightSource>& lights, const AlignedArray<LightDepthInterval>& intervals,
+    std::vector<float>& outImportance);
+
+// Tile frustum parameters in structure-of-arrays form, so that a sphere can be tested against a group of consecutive
+// tiles at once. Same data as computeTileFrustumParameters() outputs: corner rays are (leftX or rightX, topY or
+// bottomY, 1) and side planes only have two non-zero components each.
+// Arrays are padded by GroupSize - 1 elements, so that a full group can be loaded starting at any tile.
+// Frustums of super-tiles, which are blocks of SuperTileSize x SuperTileSize tiles, are kept as a coarser level.
+// They let large lights skip per-tile tests in blocks that they fully cover or miss entirely.
 struct TileFrustumCache
 {
+	static constexpr u32 GroupSize     = 8;
+	static constexpr u32 SuperTileSize = 8;
+
+	enum class Coverage : u8
+	{
+		None,    // sphere does not intersect any of the tiles
+		Partial, // tiles must be tested individually
+		Full,    // sphere intersects all of the tiles
+	};
+
 	void build(float fov, float aspect, u32 tileSize, u32 tileCountX, u32 tileCountY, u32 resolutionX);
 
-	std::vector<Vec3> m_corners;
-	std::vector<Vec3> m_planes;
+	// Unpacks parameters of a single tile into the form used by testTileFrustumSphere()
+	void getTileFrustum(u32 tileIndex, Vec3 outFrustumCornerRays[4], Vec3 outFrustumSidePlanes[4]) const;
+
+	// Shrinks the slice range to the first and last clusters of the tile whose bounding boxes intersect the sphere.
+	// Boxes are built from the tile corner rays and slice distances. Returns false if none of them do.
+	bool cullSlices(u32 tileIndex, const Vec4& sphere, const float* sliceDistances,
+	    LightTileDepthExtents& inOutDepthExtents) const;
+
+	Coverage getSuperTileCoverage(u32 superTileX, u32 superTileY, const Vec4& sphere) const;
+
+	AlignedArray<float> m_cornerLeftX;
+	AlignedArray<float> m_cornerRightX;
+	AlignedArray<float> m_cornerTopY;
+	AlignedArray<float> m_cornerBottomY;
+
+	AlignedArray<float> m_leftPlaneX;
+	AlignedArray<float> m_leftPlaneZ;
+	AlignedArray<float> m_topPlaneY;
+	AlignedArray<float> m_topPlaneZ;
+	AlignedArray<float> m_rightPlaneX;
+	AlignedArray<float> m_rightPlaneZ;
+	AlignedArray<float> m_bottomPlaneY;
+	AlignedArray<float> m_bottomPlaneZ;
+
+	std::vector<Vec3> m_superTileCornerRays; // 4 per super-tile
+	std::vector<Vec3> m_superTileSidePlanes; // 4 per super-tile
+	u32               m_superTileCountX = 0;
+	u32               m_superTileCountY = 0;
 
 	float m_tileFrustumStepSize = -1;
 	Vec2  m_tileStep            = -1;
@@ -439,11 +588,424 @@ struct TileFrustumCache
 	u32   m_resolutionX         = 0;
 };
 
-u32 performLightBinning(const DepthExtentsCalculator& depthExtentsCalculator,
-    const Mat4&                                       matProjScreenSpace, // view space to sceen space transform
-    const float cameraNearZ, int tileSize, int tileCountX, int tileCountY, const std::vector<LightSource>& lights,
-    AlignedArray<LightDepthInterval>& inOutCulledLights, LightTileScreenSpaceExtents* outLightScreenSpaceExtents,
-    u16* outCellLightCount);
+// Structure-of-arrays copy of light bounding spheres, used by the SIMD frustum culling kernel.
+// Arrays are padded to a multiple of GroupSize so that the kernel can always load full groups.
+struct LightSpheresSoA
+{
+	static constexpr u32 GroupSize = 8;
+
+	void build(const std::vector<LightSource>& lights);
+
+	// Allocates arrays for the given number of spheres and clears the padding, leaving other elements uninitialized
+	void resize(u32 lightCount);
+
+	size_t size() const { return m_count; }
+
+	AlignedArray<float> x;
+	AlignedArray<float> y;
+	AlignedArray<float> z;
+	AlignedArray<float> r;
+
+	size_t m_count = 0;
+};
+
+// Normalized planes (left, right, bottom, top, near, far) pointing into the frustum.
+// A sphere is considered visible if it is not fully behind any of the planes.
+struct FrustumPlanes
+{
+	enum
+	{
+		Left,
+		Right,
+		Bottom,
+		Top,
+		Near,
+		Far,
+
+		count
+	};
+
+	FrustumPlanes(const Mat4& matProj);
+
+	Vec4 planes[count];
+};
+
+struct LightExtentsParams
+{
+	Mat4  matProjScreenSpace; // view space to screen space transform
+	float cameraNearZ = 0;
+	u32   tileSize    = 1;
+	u32   tileCountX  = 1;
+	u32   tileCountY  = 1;
+
+	const DepthExtentsCalculator* depthExtentsCalculator = nullptr;
+};
+
+// Instruction sets that culling kernels are compiled for. Kernels are selected at run time, so that builds targeting
+// a baseline instruction set still use the widest vectors supported by the CPU.
+enum class SimdIsa
+{
+	Scalar,
+	Sse41,  // 4 lanes
+	Avx2,   // 8 lanes, also requires FMA
+	Avx512, // 16 lanes, requires AVX-512 F, CD, BW, DQ and VL
+
+	count
+};
+
+const char* toString(SimdIsa isa);
+
+// Returns true if kernels for the instruction set are compiled into this build and supported by the CPU
+bool isSimdIsaSupported(SimdIsa isa);
+
+// Widest instruction set supported on this machine, detected once
+SimdIsa getBestSimdIsa();
+
+// Instruction set of the kernels used by light builders, getBestSimdIsa() unless overridden
+SimdIsa getActiveSimdIsa();
+void    setActiveSimdIsa(SimdIsa isa);
+
+// Culling kernels compiled for one instruction set. Implementations are templates in LightingKernels.h.
+struct LightingKernels
+{
+	// Returns a bit mask of spheres in the group that are not fully behind any of the frustum planes.
+	// Sphere components are read from 32 byte aligned arrays of LightSpheresSoA::GroupSize elements.
+	u32 (*testLightSphereGroup)(const FrustumPlanes& frustum,
+	    const float*                                 sphereX,
+	    const float*                                 sphereY,
+	    const float*                                 sphereZ,
+	    const float*                                 sphereR);
+
+	// Same as testTileFrustumSphere() for tiles [firstTileIndex, firstTileIndex + TileFrustumCache::GroupSize).
+	// Returns a bit mask of tiles that may intersect the sphere. Bits of tiles past the end of the row or the cache
+	// are undefined and must be masked out by the caller.
+	u32 (*testTileFrustumSphereGroup)(const TileFrustumCache& tileFrustumCache, u32 firstTileIndex, const Vec4& sphere);
+
+	// See computeLightExtents(). sliceDistances is params.depthExtentsCalculator->sliceDistances.data().
+	void (*computeLightExtents)(const LightExtentsParams& params,
+	    const float*                                       sliceDistances,
+	    const LightSource*                                 lights,
+	    LightDepthInterval*                                inOutIntervals,
+	    u32                                                intervalCount,
+	    LightTileScreenSpaceExtents*                       outLightScreenSpaceExtents);
+
+	// Batched transformPoint() over points in structure-of-arrays form. Output arrays may alias the input arrays.
+	// Results may differ from transformPoint() in the last bit, since multiply-adds are fused where supported.
+	void (*transformPoints)(const Mat4& m,
+	    const float*                    inX,
+	    const float*                    inY,
+	    const float*                    inZ,
+	    float*                          outX,
+	    float*                          outY,
+	    float*                          outZ,
+	    u32                             count);
+};
+
+const LightingKernels& getLightingKernels(SimdIsa isa);
+
+inline const LightingKernels& getActiveLightingKernels() { return getLightingKernels(getActiveSimdIsa()); }
+
+// Computes screen space box and tile range of the light referenced by each interval, as well as the depth slice range
+// of each interval. Screen space extents are written to outLightScreenSpaceExtents[interval.lightIndex].
+void computeLightExtents(SimdIsa isa,
+    const LightExtentsParams&    params,
+    const LightSource*           lights,
+    LightDepthInterval*          inOutIntervals,
+    u32                          intervalCount,
+    LightTileScreenSpaceExtents* outLightScreenSpaceExtents);
+
+struct TileRowSpan
+{
+	u16 tileMinX;
+	u16 tileMaxX; // span is empty if tileMaxX < tileMinX
+};
+
+// Finds tiles covered by the ellipse that a light sphere projects to, one span of tiles per row of the light's screen
+// space tile extents. This avoids assigning lights to tiles in the corners of their bounding boxes.
+// Spans are conservative. Spheres that intersect the near plane and projections other than perspective ones simply get
+// full rows of their extents.
+class TileRowSpanCalculator
+{
+public:
+	TileRowSpanCalculator(const Mat4& matProjScreenSpace, float cameraNearZ, u32 tileSize);
+
+	// Writes 1 + extents.tileMax.y - extents.tileMin.y spans, starting at extents.tileMin.y
+	void calculateTileRowSpans(
+	    const LightSource& light, const LightTileScreenSpaceExtents& extents, TileRowSpan* outSpans) const;
+
+private:
+	// Screen space position in pixels is screenScale * (x / z, y / z) + screenOffset
+	Vec2  m_screenScale;
+	Vec2  m_screenOffset;
+	float m_cameraNearZ;
+	u32   m_tileSize;
+	bool  m_isPerspective;
+};
+
+struct LightCapStats
+{
+	u32   removedCount      = 0;
+	float removedImportance = 0; // sum of importance of removed cell entries
+	float totalImportance   = 0; // sum of importance of all cell entries, including removed ones
+
+	float getRemovedImportanceRatio() const { return totalImportance > 0 ? removedImportance / totalImportance : 0.0f; }
+};
+
+// Assigns light intervals to light grid cells in two parallel passes over chunks of intervals.
+// Each chunk counts cell coverage into its own histogram. Histograms are then merged and scanned into per-cell offsets
+// and per-chunk offsets within cells, so that the scatter pass needs no atomics and preserves interval order.
+struct LightBinning
+{
+	// Computes screen space and depth extents of all intervals and counts number of intervals that overlap each cell.
+	// Only tiles within the tile row spans of each light are considered if useTileRowSpans is set, otherwise the whole
+	// screen space box is used. Tiles rejected by tileFrustumCache are skipped, unless it is null. Slices are also
+	// trimmed per tile if useClusterCulling is set, which requires tileFrustumCache. If tileDepthRanges is not null,
+	// tiles whose depth range does not overlap the light are skipped and slices are trimmed to the range of the tile.
+	// Cells not set in activeCellMask (see computeActiveClusterMask()) get no entries, unless the mask is null.
+	// The mask must stay valid until scatter() is called.
+	// Returns total number of cell entries, which must be allocated before calling scatter().
+	u32 count(const DepthExtentsCalculator& depthExtentsCalculator,
+	    const Mat4&                         matProjScreenSpace, // view space to screen space transform
+	    float cameraNearZ, u32 tileSize, u32 tileCountX, u32 tileCountY, u32 sliceCount,
+	    const std::vector<LightSource>& lights, AlignedArray<LightDepthInterval>& inOutCulledLights,
+	    LightTileScreenSpaceExtents* outLightScreenSpaceExtents, const TileFrustumCache* tileFrustumCache,
+	    const TileDepthRange* tileDepthRanges, const u32* activeCellMask, bool useTileRowSpans,
+	    bool useClusterCulling);
+
+	// Writes getValue(intervalIndex) for every interval that overlaps a cell, starting at outCellItems[getCellOffset()].
+	// Must be called once after count() with the same intervals and extents.
+	template <typename T, typename F>
+	void scatter(const AlignedArray<LightDepthInterval>& intervals,
+	    const LightTileScreenSpaceExtents*              lightScreenSpaceExtents,
+	    T*                                              outCellItems,
+	    F                                               getValue);
+
+	// Keeps only the maxCount most important items of each cell after scatter(), where importance of an item is
+	// getImportance(item). Remaining items keep their order and cells are compacted, so that getCellOffset() and
+	// getCellLightCount() describe them. Total number of remaining items is getCellOffset(m_cellCount).
+	template <typename T, typename F> LightCapStats capCells(T* inOutCellItems, u32 maxCount, F getImportance);
+
+	u32 getCellOffset(u32 cellIndex) const { return m_cellOffsets[cellIndex]; }
+	u32 getCellLightCount(u32 cellIndex) const { return m_cellOffsets[cellIndex + 1] - m_cellOffsets[cellIndex]; }
+
+	// Sum of light counts of all cells in a screen space tile
+	u32 getTileLightCount(u32 tileIndex) const
+	{
+		u32 result = 0;
+		for (u32 cellIndex = tileIndex; cellIndex < m_cellCount; cellIndex += m_tilesPerSlice)
+		{
+			result += getCellLightCount(cellIndex);
+		}
+		return result;
+	}
+
+	u32  m_tileCountX          = 0;
+	u32  m_tilesPerSlice       = 0;
+	u32  m_cellCount           = 0;
+	u32  m_chunkSize           = 0;
+	u32  m_chunkCount          = 0;
+	bool m_useTileList         = false; // tiles are culled per light, either by tile frustums or by depth ranges
+	bool m_useTileRowSpans     = false;
+	bool m_useTileDepthExtents = false; // slices are trimmed per tile, either by cluster culling or by depth ranges
+
+	const u32* m_activeCellMask = nullptr;
+
+	std::vector<u32>                      m_cellOffsets; // cell count + 1 elements
+	AlignedArray<u16>                     m_chunkCellOffsets; // chunk histograms, then offsets relative to cell offsets
+	std::vector<std::vector<u32>>         m_chunkTiles; // tiles that passed culling, in interval order
+	AlignedArray<u32>                     m_intervalTileCounts; // number of entries in m_chunkTiles for each interval
+	std::vector<std::vector<TileRowSpan>> m_chunkRowSpans; // tile row spans of each interval, in interval order
+	std::vector<LightTileDepthExtents>    m_tileSliceRanges; // slices that may contain geometry in each tile
+
+	// Slice ranges of the entries in m_chunkTiles after trimming, only used if m_useTileDepthExtents is set
+	std::vector<std::vector<LightTileDepthExtents>> m_chunkTileDepthExtents;
+
+	std::vector<u32> m_cappedCellCounts; // number of items kept in each cell by capCells()
+};
+
+template <typename T, typename F>
+void LightBinning::scatter(const AlignedArray<LightDepthInterval>& intervals,
+    const LightTileScreenSpaceExtents*                             lightScreenSpaceExtents,
+    T*                                                             outCellItems,
+    F                                                              getValue)
+{
+	auto scatterChunks = [&](auto tileListFlag, auto tileRowSpansFlag, auto tileDepthExtentsFlag) {
+		constexpr bool UseTileList         = decltype(tileListFlag)::value;
+		constexpr bool UseTileRowSpans     = decltype(tileRowSpansFlag)::value;
+		constexpr bool UseTileDepthExtents = decltype(tileDepthExtentsFlag)::value;
+
+		parallelFor<u32>(0, m_chunkCount, [&](u32 chunkIndex) {
+			const u32 begin = chunkIndex * m_chunkSize;
+			const u32 end   = min<u32>(begin + m_chunkSize, (u32)intervals.size());
+
+			u16*               chunkCellOffsets = &m_chunkCellOffsets[size_t(chunkIndex) * m_cellCount];
+			const u32*         tiles            = m_chunkTiles[chunkIndex].data();
+			const TileRowSpan* rowSpans         = m_chunkRowSpans[chunkIndex].data();
+
+			const LightTileDepthExtents* tileDepthExtents = m_chunkTileDepthExtents[chunkIndex].data();
+			const u32*                   activeCellMask   = m_activeCellMask;
+
+			auto writeTile = [&](u32 tileIndex, const LightTileDepthExtents& depthExtents, T value) {
+				for (u32 z = depthExtents.sliceMin; z <= depthExtents.sliceMax; ++z)
+				{
+					const u32 cellIndex = tileIndex + z * m_tilesPerSlice;
+					if (UseTileDepthExtents && activeCellMask && !isCellActive(activeCellMask, cellIndex))
+					{
+						continue;
+					}
+					outCellItems[m_cellOffsets[cellIndex] + chunkCellOffsets[cellIndex]++] = value;
+				}
+			};
+
+			for (u32 intervalIndex = begin; intervalIndex < end; ++intervalIndex)
+			{
+				const LightDepthInterval& interval = intervals[intervalIndex];
+				const T                   value    = getValue(intervalIndex);
+
+				if (UseTileList)
+				{
+					for (u32 i = 0; i < m_intervalTileCounts[intervalIndex]; ++i)
+					{
+						writeTile(*tiles++, UseTileDepthExtents ? *tileDepthExtents++ : interval.depthExtents, value);
+					}
+				}
+				else if (UseTileRowSpans)
+				{
+					const LightTileScreenSpaceExtents& extents = lightScreenSpaceExtents[interval.lightIndex];
+					for (u32 y = extents.tileMin.y; y <= extents.tileMax.y; ++y)
+					{
+						const TileRowSpan& span = *rowSpans++;
+						for (u32 x = span.tileMinX; x <= span.tileMaxX; ++x)
+						{
+							writeTile(x + y * m_tileCountX, interval.depthExtents, value);
+						}
+					}
+				}
+				else
+				{
+					const LightTileScreenSpaceExtents& extents = lightScreenSpaceExtents[interval.lightIndex];
+					for (u32 y = extents.tileMin.y; y <= extents.tileMax.y; ++y)
+					{
+						for (u32 x = extents.tileMin.x; x <= extents.tileMax.x; ++x)
+						{
+							writeTile(x + y * m_tileCountX, interval.depthExtents, value);
+						}
+					}
+				}
+			}
+		});
+	};
+
+	dispatchFlags(scatterChunks, m_useTileList, m_useTileRowSpans, m_useTileDepthExtents);
+}
+
+template <typename T, typename F>
+LightCapStats LightBinning::capCells(T* inOutCellItems, u32 maxCount, F getImportance)
+{
+	static constexpr u32 CellsPerTask = 256;
+
+	const u32 taskCount = divUp(m_cellCount, CellsPerTask);
+
+	std::vector<LightCapStats> taskStats(taskCount);
+	m_cappedCellCounts.resize(m_cellCount);
+
+	// Cells are trimmed in place in parallel, the remaining items of each cell are moved to its beginning
+
+	parallelFor<u32>(0, taskCount, [&](u32 taskIndex) {
+		const u32 cellBegin = taskIndex * CellsPerTask;
+		const u32 cellEnd   = min(cellBegin + CellsPerTask, m_cellCount);
+
+		LightCapStats&     stats = taskStats[taskIndex];
+		std::vector<float> importance;
+		std::vector<float> selection;
+
+		for (u32 cellIndex = cellBegin; cellIndex < cellEnd; ++cellIndex)
+		{
+			T*        items = &inOutCellItems[getCellOffset(cellIndex)];
+			const u32 count = getCellLightCount(cellIndex);
+
+			importance.resize(count);
+			for (u32 i = 0; i < count; ++i)
+			{
+				importance[i] = getImportance(items[i]);
+				stats.totalImportance += importance[i];
+			}
+
+			m_cappedCellCounts[cellIndex] = min(count, maxCount);
+
+			if (count <= maxCount)
+			{
+				continue;
+			}
+
+			// Partial selection finds the least important item that is kept, ties with it are kept in order
+			selection.assign(importance.begin(), importance.end());
+			std::nth_element(selection.begin(), selection.begin() + (maxCount - 1), selection.end(),
+			    [](float a, float b) { return a > b; });
+
+			const float threshold = selection[maxCount - 1];
+
+			u32 keptTieCount = maxCount;
+			for (u32 i = 0; i < count; ++i)
+			{
+				keptTieCount -= importance[i] > threshold;
+			}
+
+			// Importance of items is effectively random, so items are kept without branches
+			u32 keptCount = 0;
+			for (u32 i = 0; i < count; ++i)
+			{
+				const bool isTie  = importance[i] == threshold;
+				const bool isKept = importance[i] > threshold || (isTie && keptTieCount != 0);
+
+				items[keptCount] = items[i];
+				keptCount += isKept;
+				keptTieCount -= isKept && isTie;
+				stats.removedImportance += isKept ? 0.0f : importance[i];
+			}
+
+			stats.removedCount += count - keptCount;
+		}
+	});
+
+	LightCapStats result;
+	for (const LightCapStats& stats : taskStats)
+	{
+		result.removedCount += stats.removedCount;
+		result.removedImportance += stats.removedImportance;
+		result.totalImportance += stats.totalImportance;
+	}
+
+	if (result.removedCount == 0)
+	{
+		return result;
+	}
+
+	// Close the gaps left by removed items. A cell may move over items of a preceding cell that were not moved yet, so
+	// remaining items are gathered into a temporary array in parallel and then copied back.
+
+	static constexpr u32 ItemsPerTask = 16384;
+
+	const u32 keptItemCount = m_cellOffsets[m_cellCount] - result.removedCount;
+
+	std::vector<T> keptItems(keptItemCount);
+
+	parallelExclusiveScan<u32>(
+	    m_cellCount, CellsPerTask, [&](u32 cellIndex) { return m_cappedCellCounts[cellIndex]; },
+	    [&](u32 cellIndex, u32 offset) {
+		    const T* items = &inOutCellItems[m_cellOffsets[cellIndex]];
+		    std::copy(items, items + m_cappedCellCounts[cellIndex], keptItems.data() + offset);
+		    m_cellOffsets[cellIndex] = offset;
+	    });
+
+	m_cellOffsets[m_cellCount] = keptItemCount;
+
+	ChunkedRange(keptItemCount, ItemsPerTask).forEachChunk([&](u32, u32 begin, u32 end) {
+		std::copy(keptItems.data() + begin, keptItems.data() + end, inOutCellItems + begin);
+	});
+
+	return result;
+}
 
 // Returns number of lights that passed frustum culling
 u32 performLightCulling(
@@ -458,4 +1020,29 @@ u32 performLightCullingAndComputeDepthIntervals(const Frustum& frustum,
     AlignedArray<u32>&                                         outIndices,
     AlignedArray<LightDepthInterval>&                          outLightIntervals);
 
+// SIMD version of the above, operating on SoA light spheres.
+// Output order matches the input order of lights.
+u32 performLightCullingAndComputeDepthIntervals(const FrustumPlanes& frustum,
+    const LightSpheresSoA&                                         lightSpheres,
+    AlignedArray<u32>&                                             outIndices,
+    AlignedArray<LightDepthInterval>&                              outLightIntervals);
+
+// Culls world space lights against a world space frustum (i.e. built from view * projection matrix) and writes view
+// space copies of the visible lights to outVisibleLights, preserving input order. Light intervals index into
+// outVisibleLights, while outIndices maps visible lights back to the input array.
+u32 performLightCullingAndTransform(const FrustumPlanes& worldSpaceFrustum,
+    const Mat4&                                          matView,
+    const AnimatedLightSource*                           lights,
+    u32                                                  lightCount,
+    AlignedArray<u32>&                                   outIndices,
+    AlignedArray<LightDepthInterval>&                    outLightIntervals,
+    std::vector<LightSource>&                            outVisibleLights);
+
+// Writes view space copies and depth intervals of lights that passed culling, in the order of visibleLightIndices.
+void transformVisibleLights(const Mat4& matView,
+    const AnimatedLightSource*          lights,
+    const AlignedArray<u32>&            visibleLightIndices,
+    AlignedArray<LightDepthInterval>&   outLightIntervals,
+    std::vector<LightSource>&           outVisibleLights);
+
 const char* toString(LightingMode mode);
@@ -0,0 +1,485 @@
+#pragma once
+
+// Culling kernels written once over the backends in Simd.h. They are instantiated in LightingKernels*.cpp files, each
+// compiled with its own instruction set flags, so functions instantiated there must only be called after checking CPU
+// support. Kernels are in an anonymous namespace, so that instantiations for the same backend in different files are
+// not merged by the linker. Rush math helpers and other inline functions from headers are avoided on purpose, since
+// linker could pick their AVX2 or AVX-512 instantiations for use from the rest of the program. Data is accessed
+// through plain members and raw pointers only.
+
+#include "LightingCommon.h"
+#include "Simd.h"
+
+namespace
+{
+
+// Same as getBoundsForAxis(), for Simd::Width spheres at once. a is the sphere center coordinate along the axis.
+template <typename Simd>
+inline void getBoundsForAxisSimd(typename Simd::Float a,
+    typename Simd::Float                             z,
+    typename Simd::Float                             r,
+    typename Simd::Float                             nearZ,
+    typename Simd::Float&                            outLowerA,
+    typename Simd::Float&                            outLowerZ,
+    typename Simd::Float&                            outUpperA,
+    typename Simd::Float&                            outUpperZ)
+{
+	typedef typename Simd::Float Float;
+	typedef typename Simd::Mask  Mask;
+
+	const Float zero = Simd::zero();
+
+	const Float radiusSquared = Simd::mul(r, r);
+	const Float lengthSquared = Simd::add(Simd::mul(a, a), Simd::mul(z, z));
+	const Float tSquared      = Simd::sub(lengthSquared, radiusSquared);
+	const Float length        = Simd::sqrt(lengthSquared);
+
+	const Mask cameraInsideSphere = Simd::cmpLe(tSquared, zero);
+
+	// (cos, sin) of angle theta between c and a tangent vector, zero if camera is inside the sphere
+	const Float cosTheta = Simd::select(cameraInsideSphere, zero, Simd::div(Simd::sqrt(tSquared), length));
+	const Float sinTheta = Simd::select(cameraInsideSphere, zero, Simd::div(r, length));
+
+	// Does the near plane intersect the sphere?
+	const Mask clipSphere = Simd::cmpLe(Simd::sub(z, r), nearZ);
+
+	// Square root of the discriminant, NaN (and unused) if the camera is in the sphere
+	const Float nearDistance = Simd::sub(z, nearZ);
+	const Float k            = Simd::sqrt(Simd::sub(radiusSquared, Simd::mul(nearDistance, nearDistance)));
+
+	const Float aCos = Simd::mul(a, cosTheta);
+	const Float aSin = Simd::mul(a, sinTheta);
+	const Float zCos = Simd::mul(z, cosTheta);
+	const Float zSin = Simd::mul(z, sinTheta);
+
+	// Tangent points, c rotated by -theta and +theta and scaled by cos theta
+	const Float upperA = Simd::mul(Simd::add(aCos, zSin), cosTheta);
+	const Float upperZ = Simd::mul(Simd::sub(zCos, aSin), cosTheta);
+	const Float lowerA = Simd::mul(Simd::sub(aCos, zSin), cosTheta);
+	const Float lowerZ = Simd::mul(Simd::add(aSin, zCos), cosTheta);
+
+	const Mask clipUpper = Simd::maskAnd(clipSphere, Simd::maskOr(cameraInsideSphere, Simd::cmpLt(upperZ, nearZ)));
+	const Mask clipLower = Simd::maskAnd(clipSphere, Simd::maskOr(cameraInsideSphere, Simd::cmpLt(lowerZ, nearZ)));
+
+	outUpperA = Simd::select(clipUpper, Simd::add(a, k), upperA);
+	outUpperZ = Simd::select(clipUpper, nearZ, upperZ);
+	outLowerA = Simd::select(clipLower, Simd::sub(a, k), lowerA);
+	outLowerZ = Simd::select(clipLower, nearZ, lowerZ);
+}
+
+// Projects points (a, z) that lie in the plane of the given matrix row and returns one projected component.
+// Operations are ordered the same way as in projectPoint().
+template <typename Simd>
+inline typename Simd::Float projectComponentSimd(typename Simd::Float a,
+    typename Simd::Float                                              z,
+    typename Simd::Float                                              rowAComponent,
+    typename Simd::Float                                              rowAW,
+    typename Simd::Float                                              row2Component,
+    typename Simd::Float                                              row2W,
+    typename Simd::Float                                              row3Component,
+    typename Simd::Float                                              row3W)
+{
+	typedef typename Simd::Float Float;
+
+	const Float component =
+	    Simd::add(Simd::add(row3Component, Simd::mul(a, rowAComponent)), Simd::mul(z, row2Component));
+	const Float w = Simd::add(Simd::add(row3W, Simd::mul(a, rowAW)), Simd::mul(z, row2W));
+	return Simd::mul(component, Simd::rcp(w));
+}
+
+// Equivalent to min(max((int)v / tileSize, 0), tileCount - 1)
+template <typename Simd>
+inline typename Simd::Int computeTileIndexSimd(
+    typename Simd::Float v, typename Simd::Int maxPixel, typename Simd::Float rcpTileSize)
+{
+	const typename Simd::Int pixel = Simd::mini(Simd::maxi(Simd::truncate(v), Simd::set1i(0)), maxPixel);
+
+	// Pixel coordinates are small integers, so offsetting by half a pixel makes the float division exact after
+	// truncation
+	const typename Simd::Float pixelCenter = Simd::add(Simd::toFloat(pixel), Simd::set1(0.5f));
+	return Simd::truncate(Simd::mul(pixelCenter, rcpTileSize));
+}
+
+// Equivalent to lower_bound over sorted values
+template <typename Simd>
+inline typename Simd::Int countLessSimd(const float* sortedValues, u32 count, typename Simd::Float v)
+{
+	typename Simd::Int result = Simd::set1i(0);
+	for (u32 i = 0; i < count; ++i)
+	{
+		result = Simd::increment(result, Simd::cmpLt(Simd::set1(sortedValues[i]), v));
+	}
+	return result;
+}
+
+template <typename Simd, bool UseExponentialSlices>
+void computeLightExtentsSimd(const LightExtentsParams& params,
+    const float*                                       sliceDistances,
+    const LightSource*                                 lights,
+    LightDepthInterval*                                inOutIntervals,
+    u32                                                intervalCount,
+    LightTileScreenSpaceExtents*                       outLightScreenSpaceExtents)
+{
+	typedef typename Simd::Float Float;
+	typedef typename Simd::Int   Int;
+
+	static constexpr u32 BatchSize = Simd::Width;
+
+	const Mat4&                   m            = params.matProjScreenSpace;
+	const DepthExtentsCalculator& depthExtents = *params.depthExtentsCalculator;
+	const u32                     sliceCount   = depthExtents.sliceCount;
+
+	const Float row0X = Simd::set1(m.rows[0].x);
+	const Float row0W = Simd::set1(m.rows[0].w);
+	const Float row1Y = Simd::set1(m.rows[1].y);
+	const Float row1W = Simd::set1(m.rows[1].w);
+	const Float row2X = Simd::set1(m.rows[2].x);
+	const Float row2Y = Simd::set1(m.rows[2].y);
+	const Float row2W = Simd::set1(m.rows[2].w);
+	const Float row3X = Simd::set1(m.rows[3].x);
+	const Float row3Y = Simd::set1(m.rows[3].y);
+	const Float row3W = Simd::set1(m.rows[3].w);
+
+	const Float nearZ       = Simd::set1(params.cameraNearZ);
+	const Float rcpTileSize = Simd::set1(1.0f / float(params.tileSize));
+	const Int   maxPixelX   = Simd::set1i(int(params.tileCountX * params.tileSize) - 1);
+	const Int   maxPixelY   = Simd::set1i(int(params.tileCountY * params.tileSize) - 1);
+
+	const Float maxSliceDepth   = Simd::set1(depthExtents.maxSliceDepth);
+	const Float sliceCountF     = Simd::set1(float(sliceCount));
+	const Float lastSliceIndexF = Simd::set1(float(sliceCount - 1));
+
+	for (u32 batchBegin = 0; batchBegin < intervalCount; batchBegin += BatchSize)
+	{
+		const u32 batchCount = intervalCount - batchBegin < BatchSize ? intervalCount - batchBegin : BatchSize;
+
+		// Gather into SoA form, padding partial batches with the last interval
+		alignas(64) float positionX[BatchSize];
+		alignas(64) float positionY[BatchSize];
+		alignas(64) float positionZ[BatchSize];
+		alignas(64) float lightRadius[BatchSize];
+		alignas(64) float intervalCenter[BatchSize];
+		alignas(64) float intervalRadius[BatchSize];
+
+		for (u32 i = 0; i < BatchSize; ++i)
+		{
+			const LightDepthInterval& interval = inOutIntervals[batchBegin + (i < batchCount ? i : batchCount - 1)];
+			const LightSource&        light    = lights[interval.lightIndex];
+
+			positionX[i]      = light.position.x;
+			positionY[i]      = light.position.y;
+			positionZ[i]      = light.position.z;
+			lightRadius[i]    = light.attenuationEnd;
+			intervalCenter[i] = interval.center;
+			intervalRadius[i] = interval.radius;
+		}
+
+		const Float x = Simd::load(positionX);
+		const Float y = Simd::load(positionY);
+		const Float z = Simd::load(positionZ);
+		const Float r = Simd::load(lightRadius);
+
+		// Screen space bounding boxes
+
+		Float leftX, leftZ, rightX, rightZ;
+		getBoundsForAxisSimd<Simd>(x, z, r, nearZ, leftX, leftZ, rightX, rightZ);
+
+		Float topY, topZ, bottomY, bottomZ;
+		getBoundsForAxisSimd<Simd>(y, z, r, nearZ, topY, topZ, bottomY, bottomZ);
+
+		const Float boxMinX = projectComponentSimd<Simd>(leftX, leftZ, row0X, row0W, row2X, row2W, row3X, row3W);
+		const Float boxMaxX = projectComponentSimd<Simd>(rightX, rightZ, row0X, row0W, row2X, row2W, row3X, row3W);
+		const Float boxMinY = projectComponentSimd<Simd>(bottomY, bottomZ, row1Y, row1W, row2Y, row2W, row3Y, row3W);
+		const Float boxMaxY = projectComponentSimd<Simd>(topY, topZ, row1Y, row1W, row2Y, row2W, row3Y, row3W);
+
+		const Int tileMinX = computeTileIndexSimd<Simd>(boxMinX, maxPixelX, rcpTileSize);
+		const Int tileMinY = computeTileIndexSimd<Simd>(boxMinY, maxPixelY, rcpTileSize);
+		const Int tileMaxX = computeTileIndexSimd<Simd>(boxMaxX, maxPixelX, rcpTileSize);
+		const Int tileMaxY = computeTileIndexSimd<Simd>(boxMaxY, maxPixelY, rcpTileSize);
+
+		// Depth slices, same as DepthExtentsCalculator::calculateDepthExtents()
+
+		const Float center   = Simd::load(intervalCenter);
+		const Float radius   = Simd::load(intervalRadius);
+		const Float depthMin = Simd::max(Simd::sub(center, radius), Simd::zero());
+		const Float depthMax = Simd::min(Simd::add(center, radius), maxSliceDepth);
+
+		Int sliceMin, sliceMax;
+		if (UseExponentialSlices)
+		{
+			sliceMin = countLessSimd<Simd>(sliceDistances, sliceCount, depthMin);
+			sliceMax = Simd::maxi(countLessSimd<Simd>(sliceDistances, sliceCount, depthMax), sliceMin);
+		}
+		else
+		{
+			const Float tMin = Simd::div(Simd::mul(sliceCountF, depthMin), maxSliceDepth);
+			const Float tMax = Simd::div(Simd::mul(sliceCountF, depthMax), maxSliceDepth);
+			sliceMin         = Simd::truncate(Simd::min(tMin, lastSliceIndexF));
+			sliceMax         = Simd::truncate(Simd::min(tMax, lastSliceIndexF));
+		}
+
+		// Scatter results
+
+		alignas(64) float boxMinXOut[BatchSize];
+		alignas(64) float boxMinYOut[BatchSize];
+		alignas(64) float boxMaxXOut[BatchSize];
+		alignas(64) float boxMaxYOut[BatchSize];
+		alignas(64) int   tileMinXOut[BatchSize];
+		alignas(64) int   tileMinYOut[BatchSize];
+		alignas(64) int   tileMaxXOut[BatchSize];
+		alignas(64) int   tileMaxYOut[BatchSize];
+		alignas(64) int   sliceMinOut[BatchSize];
+		alignas(64) int   sliceMaxOut[BatchSize];
+
+		Simd::store(boxMinXOut, boxMinX);
+		Simd::store(boxMinYOut, boxMinY);
+		Simd::store(boxMaxXOut, boxMaxX);
+		Simd::store(boxMaxYOut, boxMaxY);
+		Simd::storei(tileMinXOut, tileMinX);
+		Simd::storei(tileMinYOut, tileMinY);
+		Simd::storei(tileMaxXOut, tileMaxX);
+		Simd::storei(tileMaxYOut, tileMaxY);
+		Simd::storei(sliceMinOut, sliceMin);
+		Simd::storei(sliceMaxOut, sliceMax);
+
+		for (u32 i = 0; i < batchCount; ++i)
+		{
+			LightDepthInterval&          interval = inOutIntervals[batchBegin + i];
+			LightTileScreenSpaceExtents& extents  = outLightScreenSpaceExtents[interval.lightIndex];
+
+			extents.screenSpaceBox.m_min.x = boxMinXOut[i];
+			extents.screenSpaceBox.m_min.y = boxMinYOut[i];
+			extents.screenSpaceBox.m_max.x = boxMaxXOut[i];
+			extents.screenSpaceBox.m_max.y = boxMaxYOut[i];
+
+			extents.tileMin.x = (u32)tileMinXOut[i];
+			extents.tileMin.y = (u32)tileMinYOut[i];
+			extents.tileMax.x = (u32)tileMaxXOut[i];
+			extents.tileMax.y = (u32)tileMaxYOut[i];
+
+			interval.depthExtents.sliceMin = (u8)sliceMinOut[i];
+			interval.depthExtents.sliceMax = (u8)sliceMaxOut[i];
+		}
+	}
+}
+
+template <typename Simd>
+void computeLightExtentsSimd(const LightExtentsParams& params,
+    const float*                                       sliceDistances,
+    const LightSource*                                 lights,
+    LightDepthInterval*                                inOutIntervals,
+    u32                                                intervalCount,
+    LightTileScreenSpaceExtents*                       outLightScreenSpaceExtents)
+{
+	if (params.depthExtentsCalculator->useExponentialSlices)
+	{
+		computeLightExtentsSimd<Simd, true>(
+		    params, sliceDistances, lights, inOutIntervals, intervalCount, outLightScreenSpaceExtents);
+	}
+	else
+	{
+		computeLightExtentsSimd<Simd, false>(
+		    params, sliceDistances, lights, inOutIntervals, intervalCount, outLightScreenSpaceExtents);
+	}
+}
+
+template <typename Simd>
+u32 testLightSphereGroupSimd(const FrustumPlanes& frustum,
+    const float*                                  sphereX,
+    const float*                                  sphereY,
+    const float*                                  sphereZ,
+    const float*                                  sphereR)
+{
+	typedef typename Simd::Float Float;
+	typedef typename Simd::Mask  Mask;
+
+	static_assert(LightSpheresSoA::GroupSize % Simd::Width == 0, "Sphere group must be a multiple of SIMD width");
+
+	u32 result = 0;
+
+	for (u32 i = 0; i < LightSpheresSoA::GroupSize; i += Simd::Width)
+	{
+		const Float x    = Simd::load(sphereX + i);
+		const Float y    = Simd::load(sphereY + i);
+		const Float z    = Simd::load(sphereZ + i);
+		const Float negR = Simd::sub(Simd::zero(), Simd::load(sphereR + i));
+
+		Mask inside = Simd::cmpEq(negR, negR);
+
+		// Multiplies and adds are not fused, so that spheres close to a plane get the same result on all backends
+		for (const Vec4& plane : frustum.planes)
+		{
+			Float d = Simd::add(Simd::mul(Simd::set1(plane.x), x), Simd::set1(plane.w));
+			d       = Simd::add(Simd::mul(Simd::set1(plane.y), y), d);
+			d       = Simd::add(Simd::mul(Simd::set1(plane.z), z), d);
+			inside  = Simd::maskAnd(inside, Simd::cmpGe(d, negR));
+		}
+
+		result |= Simd::maskBits(inside) << i;
+	}
+
+	return result;
+}
+
+template <typename Simd>
+u32 testTileFrustumSphereGroupSimd(const TileFrustumCache& cache, u32 firstTileIndex, const Vec4& sphere)
+{
+	typedef typename Simd::Float Float;
+	typedef typename Simd::Mask  Mask;
+
+	static_assert(TileFrustumCache::GroupSize % Simd::Width == 0, "Tile group must be a multiple of SIMD width");
+
+	const Float zero = Simd::zero();
+	const Float one  = Simd::set1(1.0f);
+	const Float cx   = Simd::set1(sphere.x);
+	const Float cy   = Simd::set1(sphere.y);
+	const Float cz   = Simd::set1(sphere.z);
+	const Float r    = Simd::set1(sphere.w);
+
+	u32 result = 0;
+
+	for (u32 lane = 0; lane < TileFrustumCache::GroupSize; lane += Simd::Width)
+	{
+		const u32 i = firstTileIndex + lane;
+
+		const Float lx = Simd::loadu(cache.m_leftPlaneX.m_data + i);
+		const Float lz = Simd::loadu(cache.m_leftPlaneZ.m_data + i);
+		const Float ty = Simd::loadu(cache.m_topPlaneY.m_data + i);
+		const Float tz = Simd::loadu(cache.m_topPlaneZ.m_data + i);
+		const Float rx = Simd::loadu(cache.m_rightPlaneX.m_data + i);
+		const Float rz = Simd::loadu(cache.m_rightPlaneZ.m_data + i);
+		const Float by = Simd::loadu(cache.m_bottomPlaneY.m_data + i);
+		const Float bz = Simd::loadu(cache.m_bottomPlaneZ.m_data + i);
+
+		const Float dpLeft   = Simd::add(Simd::mul(lx, cx), Simd::mul(lz, cz));
+		const Float dpTop    = Simd::add(Simd::mul(ty, cy), Simd::mul(tz, cz));
+		const Float dpRight  = Simd::add(Simd::mul(rx, cx), Simd::mul(rz, cz));
+		const Float dpBottom = Simd::add(Simd::mul(by, cy), Simd::mul(bz, cz));
+
+		const Float minDotA = Simd::min(Simd::min(dpLeft, dpTop), Simd::min(dpRight, dpBottom));
+
+		// Closest plane, with the same priority as the scalar version
+		const Mask isLeft   = Simd::cmpEq(minDotA, dpLeft);
+		const Mask isTop    = Simd::maskAndNot(isLeft, Simd::cmpEq(minDotA, dpTop));
+		const Mask isRight  = Simd::maskAndNot(Simd::maskOr(isLeft, isTop), Simd::cmpEq(minDotA, dpRight));
+		const Mask isBottom = Simd::maskNot(Simd::maskOr(Simd::maskOr(isLeft, isTop), isRight));
+		const Mask isSide   = Simd::maskOr(isLeft, isRight);
+
+		// Project sphere center onto the closest plane and test it against the two adjacent planes
+		const Float nx = Simd::select(isLeft, lx, Simd::select(isRight, rx, zero));
+		const Float ny = Simd::select(isTop, ty, Simd::select(isBottom, by, zero));
+		const Float nz = Simd::select(isLeft, lz, Simd::select(isTop, tz, Simd::select(isRight, rz, bz)));
+		const Float px = Simd::sub(cx, Simd::mul(minDotA, nx));
+		const Float py = Simd::sub(cy, Simd::mul(minDotA, ny));
+		const Float pz = Simd::sub(cz, Simd::mul(minDotA, nz));
+
+		const Float dp0 = Simd::select(isSide, Simd::add(Simd::mul(ty, py), Simd::mul(tz, pz)),
+		    Simd::add(Simd::mul(lx, px), Simd::mul(lz, pz)));
+		const Float dp1 = Simd::select(isSide, Simd::add(Simd::mul(by, py), Simd::mul(bz, pz)),
+		    Simd::add(Simd::mul(rx, px), Simd::mul(rz, pz)));
+
+		const Float minDotB = Simd::min(dp0, dp1);
+		const Mask  isFirst = Simd::cmpEq(minDotB, dp0);
+
+		const Float x0 = Simd::loadu(cache.m_cornerLeftX.m_data + i);
+		const Float x1 = Simd::loadu(cache.m_cornerRightX.m_data + i);
+		const Float y0 = Simd::loadu(cache.m_cornerTopY.m_data + i);
+		const Float y1 = Simd::loadu(cache.m_cornerBottomY.m_data + i);
+
+		const Float rayX = Simd::select(isLeft, x0, Simd::select(isRight, x1, Simd::select(isFirst, x0, x1)));
+		const Float rayY = Simd::select(isTop, y0, Simd::select(isBottom, y1, Simd::select(isFirst, y0, y1)));
+
+		// Sphere center is not outside of the corner, so single plane test is enough
+		const Mask planeResult = Simd::cmpLt(Simd::sub(zero, minDotA), r);
+
+		// Otherwise test the ray that passes from origin through the corner
+		const Float rayLengthSquared = Simd::add(Simd::add(Simd::mul(rayX, rayX), Simd::mul(rayY, rayY)), one);
+		const Float t  = Simd::max(zero, Simd::add(Simd::add(Simd::mul(cx, rayX), Simd::mul(cy, rayY)), cz));
+		const Float bX = Simd::sub(cx, Simd::div(Simd::mul(rayX, t), rayLengthSquared));
+		const Float bY = Simd::sub(cy, Simd::div(Simd::mul(rayY, t), rayLengthSquared));
+		const Float bZ = Simd::sub(cz, Simd::div(t, rayLengthSquared));
+		const Float d2 = Simd::add(Simd::add(Simd::mul(bX, bX), Simd::mul(bY, bY)), Simd::mul(bZ, bZ));
+
+		const Mask cornerResult = Simd::cmpLt(d2, Simd::mul(r, r));
+		const Mask usePlane     = Simd::cmpGt(minDotB, zero);
+
+		const Mask visible =
+		    Simd::maskOr(Simd::maskAnd(usePlane, planeResult), Simd::maskAndNot(usePlane, cornerResult));
+
+		result |= Simd::maskBits(visible) << lane;
+	}
+
+	return result;
+}
+
+template <typename Simd>
+void transformPointsSimd(const Mat4& m,
+    const float*                     inX,
+    const float*                     inY,
+    const float*                     inZ,
+    float*                           outX,
+    float*                           outY,
+    float*                           outZ,
+    u32                              count)
+{
+	typedef typename Simd::Float Float;
+
+	const Float m00 = Simd::set1(m.rows[0].x), m01 = Simd::set1(m.rows[0].y), m02 = Simd::set1(m.rows[0].z);
+	const Float m10 = Simd::set1(m.rows[1].x), m11 = Simd::set1(m.rows[1].y), m12 = Simd::set1(m.rows[1].z);
+	const Float m20 = Simd::set1(m.rows[2].x), m21 = Simd::set1(m.rows[2].y), m22 = Simd::set1(m.rows[2].z);
+	const Float m30 = Simd::set1(m.rows[3].x), m31 = Simd::set1(m.rows[3].y), m32 = Simd::set1(m.rows[3].z);
+
+	auto transform = [&](const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz) {
+		const Float x = Simd::loadu(px);
+		const Float y = Simd::loadu(py);
+		const Float z = Simd::loadu(pz);
+		Simd::storeu(ox, Simd::fmadd(z, m20, Simd::fmadd(y, m10, Simd::fmadd(x, m00, m30))));
+		Simd::storeu(oy, Simd::fmadd(z, m21, Simd::fmadd(y, m11, Simd::fmadd(x, m01, m31))));
+		Simd::storeu(oz, Simd::fmadd(z, m22, Simd::fmadd(y, m12, Simd::fmadd(x, m02, m32))));
+	};
+
+	u32 i = 0;
+	for (; i + Simd::Width <= count; i += Simd::Width)
+	{
+		transform(inX + i, inY + i, inZ + i, outX + i, outY + i, outZ + i);
+	}
+
+	// Remaining points go through a padded copy, so that every point is transformed with the same instructions
+
+	if (i < count)
+	{
+		const u32 remainder = count - i;
+
+		float x[Simd::Width] = {}, y[Simd::Width] = {}, z[Simd::Width] = {};
+		for (u32 j = 0; j < remainder; ++j)
+		{
+			x[j] = inX[i + j];
+			y[j] = inY[i + j];
+			z[j] = inZ[i + j];
+		}
+
+		transform(x, y, z, x, y, z);
+
+		for (u32 j = 0; j < remainder; ++j)
+		{
+			outX[i + j] = x[j];
+			outY[i + j] = y[j];
+			outZ[i + j] = z[j];
+		}
+	}
+}
+
+// Culling kernels for the given backend. GroupSimd is used by kernels that work on fixed size groups of spheres or
+// tiles and must not be wider than the group. Point transform also uses GroupSimd, since it is called for one sphere
+// group at a time and larger arrays are limited by memory bandwidth rather than vector width.
+template <typename Simd, typename GroupSimd> inline LightingKernels makeLightingKernels()
+{
+	LightingKernels result;
+	result.testLightSphereGroup       = testLightSphereGroupSimd<GroupSimd>;
+	result.testTileFrustumSphereGroup = testTileFrustumSphereGroupSimd<GroupSimd>;
+	result.computeLightExtents        = computeLightExtentsSimd<Simd>;
+	result.transformPoints            = transformPointsSimd<GroupSimd>;
+	return result;
+}
+
+} // namespace
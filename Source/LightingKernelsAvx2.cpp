@@ -0,0 +1,5 @@
+// AVX2 versions of culling kernels. This file is compiled with AVX2 and FMA enabled.
+
+#include "LightingKernels.h"
+
+LightingKernels getLightingKernelsAvx2() { return makeLightingKernels<SimdAvx2, SimdAvx2>(); }
@@ -0,0 +1,6 @@
+// AVX-512 versions of culling kernels. This file is compiled with AVX-512 (F, CD, BW, DQ, VL) and FMA enabled.
+// Groups of spheres and tiles are only 8 elements, so group kernels use 256 bit vectors.
+
+#include "LightingKernels.h"
+
+LightingKernels getLightingKernelsAvx512() { return makeLightingKernels<SimdAvx512, SimdAvx2>(); }
@@ -0,0 +1,5 @@
+// SSE4.1 versions of culling kernels. This file is compiled with SSE4.1 enabled.
+
+#include "LightingKernels.h"
+
+LightingKernels getLightingKernelsSse41() { return makeLightingKernels<SimdSse41, SimdSse41>(); }
@@ -0,0 +1,427 @@
+#include "OcclusionCulling.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <float.h>
+
+void OccluderMesh::build(const Model& model, u32 maxTriangleCount)
+{
+	const u32 triangleCount = u32(model.indices.size() / 3);
+
+	auto getTriangleArea = [&](u32 triangleIndex) {
+		const Vec3& a = model.vertices[model.indices[triangleIndex * 3 + 0]].position;
+		const Vec3& b = model.vertices[model.indices[triangleIndex * 3 + 1]].position;
+		const Vec3& c = model.vertices[model.indices[triangleIndex * 3 + 2]].position;
+		return cross(b - a, c - a).length();
+	};
+
+	std::vector<u32> triangles(triangleCount);
+	for (u32 i = 0; i < triangleCount; ++i)
+	{
+		triangles[i] = i;
+	}
+
+	if (triangleCount > maxTriangleCount)
+	{
+		std::vector<float> areas(triangleCount);
+		parallelFor<u32>(0, triangleCount, [&](u32 i) { areas[i] = getTriangleArea(i); });
+
+		std::nth_element(triangles.begin(), triangles.begin() + maxTriangleCount, triangles.end(),
+		    [&](u32 a, u32 b) { return areas[a] > areas[b]; });
+		triangles.resize(maxTriangleCount);
+
+		// Keep original order for better vertex locality
+		std::sort(triangles.begin(), triangles.end());
+	}
+
+	positionX.clear();
+	positionY.clear();
+	positionZ.clear();
+	indices.clear();
+	indices.reserve(triangles.size() * 3);
+
+	std::vector<u32> vertexRemap(model.vertices.size(), ~0u);
+	for (u32 triangleIndex : triangles)
+	{
+		for (u32 i = 0; i < 3; ++i)
+		{
+			const u32 vertexIndex = model.indices[triangleIndex * 3 + i];
+			if (vertexRemap[vertexIndex] == ~0u)
+			{
+				const Vec3& position     = model.vertices[vertexIndex].position;
+				vertexRemap[vertexIndex] = u32(positionX.size());
+				positionX.push_back(position.x);
+				positionY.push_back(position.y);
+				positionZ.push_back(position.z);
+			}
+			indices.push_back(vertexRemap[vertexIndex]);
+		}
+	}
+}
+
+void OcclusionBuffer::render(
+    const Camera& camera, const Mat4& matView, const OccluderMesh& occluders, u32 width, u32 height)
+{
+	static constexpr u32 VerticesPerTask = 4096;
+	static constexpr u32 RowsPerTask     = 8;
+
+	const Vec2 resolutionF = Vec2(float(width), float(height));
+
+	const Mat4 m =
+	    camera.buildProjMatrix() * Mat4::scaleTranslate(Vec3(0.5f * resolutionF.x, -0.5f * resolutionF.y, 1.0f),
+	                                   Vec3(0.5f * resolutionF.x, 0.5f * resolutionF.y, 0.0f));
+
+	// Same requirements as TileRowSpanCalculator
+	const bool isPerspective = m.rows[0].w == 0 && m.rows[1].w == 0 && m.rows[2].w != 0 && m.rows[3].w == 0 &&
+	                           m.rows[0].y == 0 && m.rows[1].x == 0 && m.rows[3].x == 0 && m.rows[3].y == 0;
+
+	if (!isPerspective || width == 0 || height == 0)
+	{
+		m_levels.clear();
+		return;
+	}
+
+	m_screenScale  = Vec2(m.rows[0].x, m.rows[1].y) / m.rows[2].w;
+	m_screenOffset = Vec2(m.rows[2].x, m.rows[2].y) / m.rows[2].w;
+	m_cameraNearZ  = camera.getNearPlane();
+
+	u32 levelCount = 1;
+	for (u32 w = width, h = height; w > 1 || h > 1; w = divUp(w, 2u), h = divUp(h, 2u))
+	{
+		++levelCount;
+	}
+
+	m_levels.resize(levelCount);
+	for (u32 levelIndex = 0; levelIndex < levelCount; ++levelIndex)
+	{
+		Level& level = m_levels[levelIndex];
+		level.width  = levelIndex ? divUp(m_levels[levelIndex - 1].width, 2u) : width;
+		level.height = levelIndex ? divUp(m_levels[levelIndex - 1].height, 2u) : height;
+		level.depth.resize(level.width * level.height);
+	}
+
+	// Level 0 holds inverse depth while rasterizing, so that pixels are updated without divisions
+	std::fill(m_levels[0].depth.begin(), m_levels[0].depth.end(), 0.0f);
+
+	// Transform occluder vertices to view space
+
+	const u32 vertexCount = u32(occluders.positionX.size());
+
+	m_viewSpaceX.resize(vertexCount);
+	m_viewSpaceY.resize(vertexCount);
+	m_viewSpaceZ.resize(vertexCount);
+
+	const LightingKernels& kernels = getActiveLightingKernels();
+
+	parallelFor<u32>(0, divUp(vertexCount, VerticesPerTask), [&](u32 taskIndex) {
+		const u32 begin = taskIndex * VerticesPerTask;
+		const u32 count = min(vertexCount - begin, VerticesPerTask);
+		kernels.transformPoints(matView, &occluders.positionX[begin], &occluders.positionY[begin],
+		    &occluders.positionZ[begin], &m_viewSpaceX[begin], &m_viewSpaceY[begin], &m_viewSpaceZ[begin], count);
+	});
+
+	// Clip triangles against the near plane and project them to the buffer
+
+	const u32 triangleCount = occluders.getTriangleCount();
+
+	m_screenTriangles.resize(triangleCount * 2);
+
+	parallelFor<u32>(0, triangleCount, [&](u32 triangleIndex) {
+		ScreenTriangle* outTriangles = &m_screenTriangles[triangleIndex * 2];
+		outTriangles[0].maxY         = -1;
+		outTriangles[0].minY         = 0;
+		outTriangles[1].maxY         = -1;
+		outTriangles[1].minY         = 0;
+
+		Vec3 vertices[3];
+		for (u32 i = 0; i < 3; ++i)
+		{
+			const u32 vertexIndex = occluders.indices[triangleIndex * 3 + i];
+			vertices[i]           = Vec3(m_viewSpaceX[vertexIndex], m_viewSpaceY[vertexIndex], m_viewSpaceZ[vertexIndex]);
+		}
+
+		Vec3 polygon[4];
+		u32  polygonSize = 0;
+		for (u32 i = 0; i < 3; ++i)
+		{
+			const Vec3& a = vertices[i];
+			const Vec3& b = vertices[(i + 1) % 3];
+			if (a.z >= m_cameraNearZ)
+			{
+				polygon[polygonSize++] = a;
+			}
+			if ((a.z >= m_cameraNearZ) != (b.z >= m_cameraNearZ))
+			{
+				const float t          = (m_cameraNearZ - a.z) / (b.z - a.z);
+				polygon[polygonSize++] = Vec3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, m_cameraNearZ);
+			}
+		}
+
+		for (u32 i = 2; i < polygonSize; ++i)
+		{
+			ScreenTriangle& triangle = outTriangles[i - 2];
+
+			const Vec3* triangleVertices[3] = {&polygon[0], &polygon[i - 1], &polygon[i]};
+
+			float boundsMinX = FLT_MAX, boundsMaxX = -FLT_MAX;
+			float boundsMinY = FLT_MAX, boundsMaxY = -FLT_MAX;
+
+			for (u32 j = 0; j < 3; ++j)
+			{
+				const Vec3& p        = *triangleVertices[j];
+				triangle.invDepth[j] = 1.0f / p.z;
+				triangle.position[j] = Vec2(p.x, p.y) * triangle.invDepth[j] * m_screenScale + m_screenOffset;
+
+				boundsMinX = min(boundsMinX, triangle.position[j].x);
+				boundsMaxX = max(boundsMaxX, triangle.position[j].x);
+				boundsMinY = min(boundsMinY, triangle.position[j].y);
+				boundsMaxY = max(boundsMaxY, triangle.position[j].y);
+			}
+
+			// Pixels whose centers may be inside of the triangle
+			triangle.minX = (int)max(floorf(boundsMinX - 0.5f), 0.0f);
+			triangle.minY = (int)max(floorf(boundsMinY - 0.5f), 0.0f);
+			triangle.maxX = (int)min(ceilf(boundsMaxX - 0.5f), float(width - 1));
+			triangle.maxY = (int)min(ceilf(boundsMaxY - 0.5f), float(height - 1));
+		}
+	});
+
+	// Rasterize rows of the buffer in parallel, so that no two tasks write the same pixels
+
+	parallelFor<u32>(0, divUp(height, RowsPerTask), [&](u32 taskIndex) {
+		const u32 rowBegin = taskIndex * RowsPerTask;
+		const u32 rowEnd   = min(rowBegin + RowsPerTask, height);
+
+		for (const ScreenTriangle& triangle : m_screenTriangles)
+		{
+			if (triangle.minY < (int)rowEnd && triangle.maxY >= (int)rowBegin && triangle.minX <= triangle.maxX)
+			{
+				rasterize(triangle, rowBegin, rowEnd);
+			}
+		}
+
+		float* depth = &m_levels[0].depth[rowBegin * width];
+		for (u32 i = 0; i < (rowEnd - rowBegin) * width; ++i)
+		{
+			depth[i] = depth[i] > 0 ? 1.0f / depth[i] : FLT_MAX;
+		}
+	});
+
+	// Build the pyramid
+
+	for (u32 levelIndex = 1; levelIndex < levelCount; ++levelIndex)
+	{
+		const Level& source = m_levels[levelIndex - 1];
+		Level&       target = m_levels[levelIndex];
+
+		parallelFor<u32>(0, target.height, [&](u32 y) {
+			const u32 y0 = y * 2;
+			const u32 y1 = min(y0 + 1, source.height - 1);
+			for (u32 x = 0; x < target.width; ++x)
+			{
+				const u32 x0 = x * 2;
+				const u32 x1 = min(x0 + 1, source.width - 1);
+
+				target.depth[x + y * target.width] =
+				    max(max(source.depth[x0 + y0 * source.width], source.depth[x1 + y0 * source.width]),
+				        max(source.depth[x0 + y1 * source.width], source.depth[x1 + y1 * source.width]));
+			}
+		});
+	}
+}
+
+void OcclusionBuffer::rasterize(const ScreenTriangle& triangle, u32 rowBegin, u32 rowEnd)
+{
+	Vec2  p0 = triangle.position[0];
+	Vec2  p1 = triangle.position[1];
+	Vec2  p2 = triangle.position[2];
+	float w0 = triangle.invDepth[0];
+	float w1 = triangle.invDepth[1];
+	float w2 = triangle.invDepth[2];
+
+	float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+	if (area == 0)
+	{
+		return;
+	}
+
+	// Occluders are double sided
+	if (area < 0)
+	{
+		std::swap(p1, p2);
+		std::swap(w1, w2);
+		area = -area;
+	}
+
+	// Edge function of edge from -> to, positive on the inside of the triangle.
+	// Triangles sharing an edge evaluate it with negated coefficients, which gives them exactly the same row
+	// intersections, so that every pixel center along the edge is covered by exactly one of them.
+	struct Edge
+	{
+		float a, b, c;
+
+		Edge(const Vec2& from, const Vec2& to) : a(from.y - to.y), b(to.x - from.x), c(from.x * to.y - from.y * to.x)
+		{
+		}
+
+		// Narrows the range [inOutBegin, inOutEnd) of pixels of a row to the ones whose centers are inside of the
+		// edge. Centers exactly on the edge are inside of top and left edges only.
+		void clipRow(float y, float& inOutBegin, float& inOutEnd) const
+		{
+			const float e = b * y + c;
+			if (a > 0)
+			{
+				inOutBegin = max(inOutBegin, ceilf(-e / a - 0.5f));
+			}
+			else if (a < 0)
+			{
+				inOutEnd = min(inOutEnd, ceilf(-e / a - 0.5f));
+			}
+			else if (e < 0 || (e == 0 && b > 0))
+			{
+				inOutEnd = inOutBegin;
+			}
+		}
+	};
+
+	const Edge e0(p1, p2);
+	const Edge e1(p2, p0);
+	const Edge e2(p0, p1);
+
+	// Inverse depth is an affine function of the pixel position
+	const float invArea     = 1.0f / area;
+	const float gradX       = (e0.a * w0 + e1.a * w1 + e2.a * w2) * invArea;
+	const float gradY       = (e0.b * w0 + e1.b * w1 + e2.b * w2) * invArea;
+	const float offset      = (e0.c * w0 + e1.c * w1 + e2.c * w2) * invArea;
+	const float minInvDepth = min(w0, min(w1, w2));
+
+	// Farthest depth of the plane within the pixel is at one of its corners
+	const float cornerOffset = 0.5f * (fabsf(gradX) + fabsf(gradY));
+
+	Level& level = m_levels[0];
+
+	const u32 yBegin = max<u32>(triangle.minY, rowBegin);
+	const u32 yEnd   = min<u32>(triangle.maxY + 1, rowEnd);
+
+	for (u32 y = yBegin; y < yEnd; ++y)
+	{
+		const float py  = float(y) + 0.5f;
+		float*      row = &level.depth[y * level.width];
+
+		float begin = float(triangle.minX);
+		float end   = float(triangle.maxX + 1);
+		e0.clipRow(py, begin, end);
+		e1.clipRow(py, begin, end);
+		e2.clipRow(py, begin, end);
+
+		if (begin >= end)
+		{
+			continue;
+		}
+
+		const float rowInvDepth = gradY * py + offset - cornerOffset;
+
+		for (int x = (int)begin; x < (int)end; ++x)
+		{
+			const float invDepth = max(gradX * (float(x) + 0.5f) + rowInvDepth, minInvDepth);
+			row[x]               = max(row[x], invDepth);
+		}
+	}
+}
+
+bool OcclusionBuffer::isSphereOccluded(const Vec3& center, float radius) const
+{
+	const float nearestDepth = center.z - radius;
+
+	if (m_levels.empty() || nearestDepth <= m_cameraNearZ)
+	{
+		return false;
+	}
+
+	// Project the bounding box of the sphere, whose depth range is positive
+	const float farthestDepth = center.z + radius;
+	const float minX = min((center.x - radius) / nearestDepth, (center.x - radius) / farthestDepth);
+	const float maxX = max((center.x + radius) / nearestDepth, (center.x + radius) / farthestDepth);
+	const float minY = min((center.y - radius) / nearestDepth, (center.y - radius) / farthestDepth);
+	const float maxY = max((center.y + radius) / nearestDepth, (center.y + radius) / farthestDepth);
+
+	const Vec2 a = Vec2(minX, minY) * m_screenScale + m_screenOffset;
+	const Vec2 b = Vec2(maxX, maxY) * m_screenScale + m_screenOffset;
+
+	const Level& level0 = m_levels[0];
+
+	// Covered pixels, expanded by one pixel to include partially covered ones along occluder edges
+	const int pixelMinX = max((int)floorf(min(a.x, b.x)) - 1, 0);
+	const int pixelMinY = max((int)floorf(min(a.y, b.y)) - 1, 0);
+	const int pixelMaxX = min((int)floorf(max(a.x, b.x)) + 1, (int)level0.width - 1);
+	const int pixelMaxY = min((int)floorf(max(a.y, b.y)) + 1, (int)level0.height - 1);
+
+	if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+	{
+		return false;
+	}
+
+	// Finest level at which the pixels fit in 2x2 texels
+	u32 levelIndex = 0;
+	while ((pixelMaxX >> levelIndex) - (pixelMinX >> levelIndex) > 1 ||
+	       (pixelMaxY >> levelIndex) - (pixelMinY >> levelIndex) > 1)
+	{
+		++levelIndex;
+	}
+
+	const Level& level = m_levels[levelIndex];
+
+	const u32 x0 = u32(pixelMinX) >> levelIndex;
+	const u32 x1 = u32(pixelMaxX) >> levelIndex;
+	const u32 y0 = u32(pixelMinY) >> levelIndex;
+	const u32 y1 = u32(pixelMaxY) >> levelIndex;
+
+	const float occluderDepth = max(max(level.depth[x0 + y0 * level.width], level.depth[x1 + y0 * level.width]),
+	    max(level.depth[x0 + y1 * level.width], level.depth[x1 + y1 * level.width]));
+
+	return nearestDepth > occluderDepth;
+}
+
+u32 cullOccludedLights(const OcclusionBuffer& occlusionBuffer, const std::vector<LightSource>& viewSpaceLights,
+    AlignedArray<LightDepthInterval>& inOutIntervals, AlignedArray<LightDepthInterval>& tempIntervals)
+{
+	static constexpr u32 IntervalsPerTask = 256;
+
+	const u32 intervalCount = u32(inOutIntervals.size());
+
+	// Results of the occlusion test are kept between the passes, so that each light is only tested once
+	std::vector<u8> intervalVisibility(intervalCount);
+
+	auto countVisibleIntervals = [&](u32 begin, u32 end) {
+		u32 visibleCount = 0;
+		for (u32 i = begin; i < end; ++i)
+		{
+			const LightSource& light = viewSpaceLights[inOutIntervals[i].lightIndex];
+			const bool isVisible     = !occlusionBuffer.isSphereOccluded(light.position, light.attenuationEnd);
+
+			intervalVisibility[i] = isVisible;
+			visibleCount += isVisible ? 1 : 0;
+		}
+		return visibleCount;
+	};
+
+	auto writeVisibleIntervals = [&](u32 begin, u32 end, u32 writeIndex) {
+		for (u32 i = begin; i < end; ++i)
+		{
+			if (intervalVisibility[i])
+			{
+				tempIntervals[writeIndex++] = inOutIntervals[i];
+			}
+		}
+	};
+
+	tempIntervals.resize(intervalCount);
+
+	const u32 remainingCount =
+	    parallelCompact(intervalCount, IntervalsPerTask, countVisibleIntervals, writeVisibleIntervals);
+
+	inOutIntervals.swap(tempIntervals);
+	inOutIntervals.m_count = remainingCount;
+
+	return remainingCount;
+}
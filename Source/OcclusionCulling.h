@@ -0,0 +1,82 @@
+#pragma once
+
+#include "LightingCommon.h"
+#include "Model.h"
+
+#include <Rush/MathTypes.h>
+#include <Rush/UtilCamera.h>
+
+#include <vector>
+
+// World space triangles of a model that are used as occluders, in structure-of-arrays form.
+// Only the largest triangles are kept, since small ones rarely hide anything in a low resolution depth buffer.
+struct OccluderMesh
+{
+	void build(const Model& model, u32 maxTriangleCount = 32768);
+
+	u32 getTriangleCount() const { return u32(indices.size() / 3); }
+
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<u32>   indices;
+};
+
+// Low resolution view space depth buffer of occluders rasterized on the CPU, with a pyramid of maximum depths
+// (hierarchical Z) that is used to find lights hidden behind the occluders.
+// Coverage is sampled at pixel centers, so that adjacent triangles leave no cracks. Each covered pixel stores the
+// farthest depth of the triangle plane within the pixel, and queries are expanded by one pixel to account for
+// triangle edges that only partially cover pixels.
+class OcclusionBuffer
+{
+public:
+	// Rasterizes occluders as seen by the camera into a width x height buffer covering the whole viewport.
+	// Projection must be a perspective one, otherwise nothing is treated as occluded.
+	void render(const Camera& camera, const Mat4& matView, const OccluderMesh& occluders, u32 width, u32 height);
+
+	// Returns true if a view space sphere is entirely behind the occluders. Parts of the sphere outside of the viewport
+	// are ignored, since they can not light any visible pixels.
+	bool isSphereOccluded(const Vec3& center, float radius) const;
+
+	u32 getWidth() const { return m_levels.empty() ? 0 : m_levels[0].width; }
+	u32 getHeight() const { return m_levels.empty() ? 0 : m_levels[0].height; }
+
+	struct Level
+	{
+		u32                width  = 0;
+		u32                height = 0;
+		std::vector<float> depth; // view space depth, FLT_MAX where nothing was rasterized
+	};
+
+	// Level 0 is the rasterized depth buffer, each following level holds the maximum of 2x2 texels of the previous one
+	std::vector<Level> m_levels;
+
+private:
+	struct ScreenTriangle
+	{
+		Vec2  position[3]; // pixel coordinates
+		float invDepth[3];
+		int   minX, maxX, minY, maxY; // pixel bounds, empty if maxY < minY
+	};
+
+	void rasterize(const ScreenTriangle& triangle, u32 rowBegin, u32 rowEnd);
+
+	// Buffer position in pixels is screenScale * (x / z, y / z) + screenOffset
+	Vec2  m_screenScale;
+	Vec2  m_screenOffset;
+	float m_cameraNearZ = 0;
+
+	std::vector<float>          m_viewSpaceX;
+	std::vector<float>          m_viewSpaceY;
+	std::vector<float>          m_viewSpaceZ;
+	std::vector<ScreenTriangle> m_screenTriangles; // two per occluder triangle, since near plane clipping may split one
+};
+
+// Removes intervals of lights that are hidden behind occluders, keeping the order of the remaining ones.
+// Occlusion buffer must be rendered with the camera that viewSpaceLights are relative to.
+// Contents of tempIntervals are swapped with inOutIntervals and left undefined.
+// Returns number of remaining intervals.
+u32 cullOccludedLights(const OcclusionBuffer& occlusionBuffer,
+    const std::vector<LightSource>&           viewSpaceLights,
+    AlignedArray<LightDepthInterval>&         inOutIntervals,
+    AlignedArray<LightDepthInterval>&         tempIntervals);
@@ -0,0 +1,228 @@
+#pragma once
+
+// Thin wrappers over SIMD instruction sets, so that kernels can be written once as templates over the backend type and
+// compiled for each instruction set in its own translation unit (see LightingKernels.h).
+// Each backend provides Float, Int and Mask vector types of Width lanes and a common set of static functions.
+// Backends are only defined when the compiler targets their instruction set. They live in an anonymous namespace, so
+// that every translation unit gets its own copies compiled with its own flags, instead of the linker picking one.
+
+#include <Rush/Rush.h>
+
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+struct SimdScalar
+{
+	typedef float Float;
+	typedef int   Int;
+	typedef bool  Mask;
+
+	static constexpr u32 Width = 1;
+
+	static inline Float zero() { return 0.0f; }
+	static inline Float set1(float v) { return v; }
+	static inline Float load(const float* p) { return *p; }
+	static inline Float loadu(const float* p) { return *p; }
+	static inline void  store(float* p, Float v) { *p = v; }
+	static inline void  storeu(float* p, Float v) { *p = v; }
+
+	static inline Float add(Float a, Float b) { return a + b; }
+	static inline Float sub(Float a, Float b) { return a - b; }
+	static inline Float mul(Float a, Float b) { return a * b; }
+	static inline Float div(Float a, Float b) { return a / b; }
+	static inline Float fmadd(Float a, Float b, Float c) { return a * b + c; }
+	static inline Float sqrt(Float a) { return sqrtf(a); }
+	static inline Float rcp(Float a) { return 1.0f / a; }
+	static inline Float min(Float a, Float b) { return a < b ? a : b; }
+	static inline Float max(Float a, Float b) { return a > b ? a : b; }
+
+	static inline Mask cmpEq(Float a, Float b) { return a == b; }
+	static inline Mask cmpLt(Float a, Float b) { return a < b; }
+	static inline Mask cmpLe(Float a, Float b) { return a <= b; }
+	static inline Mask cmpGt(Float a, Float b) { return a > b; }
+	static inline Mask cmpGe(Float a, Float b) { return a >= b; }
+
+	static inline Mask maskAnd(Mask a, Mask b) { return a && b; }
+	static inline Mask maskOr(Mask a, Mask b) { return a || b; }
+	static inline Mask maskAndNot(Mask a, Mask b) { return !a && b; } // (not a) and b
+	static inline Mask maskNot(Mask a) { return !a; }
+	static inline u32  maskBits(Mask a) { return u32(a); }
+
+	static inline Float select(Mask m, Float a, Float b) { return m ? a : b; } // a where m is set, otherwise b
+
+	static inline Int   set1i(int v) { return v; }
+	static inline Int   mini(Int a, Int b) { return a < b ? a : b; }
+	static inline Int   maxi(Int a, Int b) { return a > b ? a : b; }
+	static inline Int   increment(Int a, Mask m) { return a + int(m); } // adds 1 where m is set
+	static inline Int   truncate(Float a) { return int(a); }
+	static inline Float toFloat(Int a) { return float(a); }
+	static inline void  storei(int* p, Int v) { *p = v; }
+};
+
+// MSVC does not define a macro for SSE4.1, but allows its intrinsics in any x86 code
+#if defined(__SSE4_1__) || defined(_M_X64) || defined(_M_IX86)
+struct SimdSse41
+{
+	typedef __m128  Float;
+	typedef __m128i Int;
+	typedef __m128  Mask;
+
+	static constexpr u32 Width = 4;
+
+	static inline Float zero() { return _mm_setzero_ps(); }
+	static inline Float set1(float v) { return _mm_set1_ps(v); }
+	static inline Float load(const float* p) { return _mm_load_ps(p); }
+	static inline Float loadu(const float* p) { return _mm_loadu_ps(p); }
+	static inline void  store(float* p, Float v) { _mm_store_ps(p, v); }
+	static inline void  storeu(float* p, Float v) { _mm_storeu_ps(p, v); }
+
+	static inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+	static inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	static inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	static inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+	static inline Float fmadd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	static inline Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+	static inline Float rcp(Float a) { return _mm_rcp_ps(a); }
+	static inline Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+	static inline Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+
+	static inline Mask cmpEq(Float a, Float b) { return _mm_cmpeq_ps(a, b); }
+	static inline Mask cmpLt(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+	static inline Mask cmpLe(Float a, Float b) { return _mm_cmple_ps(a, b); }
+	static inline Mask cmpGt(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+	static inline Mask cmpGe(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+
+	static inline Mask maskAnd(Mask a, Mask b) { return _mm_and_ps(a, b); }
+	static inline Mask maskOr(Mask a, Mask b) { return _mm_or_ps(a, b); }
+	static inline Mask maskAndNot(Mask a, Mask b) { return _mm_andnot_ps(a, b); }
+	static inline Mask maskNot(Mask a) { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+	static inline u32  maskBits(Mask a) { return (u32)_mm_movemask_ps(a); }
+
+	static inline Float select(Mask m, Float a, Float b) { return _mm_blendv_ps(b, a, m); }
+
+	static inline Int   set1i(int v) { return _mm_set1_epi32(v); }
+	static inline Int   mini(Int a, Int b) { return _mm_min_epi32(a, b); }
+	static inline Int   maxi(Int a, Int b) { return _mm_max_epi32(a, b); }
+	static inline Int   increment(Int a, Mask m) { return _mm_sub_epi32(a, _mm_castps_si128(m)); }
+	static inline Int   truncate(Float a) { return _mm_cvttps_epi32(a); }
+	static inline Float toFloat(Int a) { return _mm_cvtepi32_ps(a); }
+	static inline void  storei(int* p, Int v) { _mm_store_si128((__m128i*)p, v); }
+};
+#endif
+
+#if defined(__AVX2__)
+struct SimdAvx2
+{
+	typedef __m256  Float;
+	typedef __m256i Int;
+	typedef __m256  Mask;
+
+	static constexpr u32 Width = 8;
+
+	static inline Float zero() { return _mm256_setzero_ps(); }
+	static inline Float set1(float v) { return _mm256_set1_ps(v); }
+	static inline Float load(const float* p) { return _mm256_load_ps(p); }
+	static inline Float loadu(const float* p) { return _mm256_loadu_ps(p); }
+	static inline void  store(float* p, Float v) { _mm256_store_ps(p, v); }
+	static inline void  storeu(float* p, Float v) { _mm256_storeu_ps(p, v); }
+
+	static inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	static inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	static inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+	static inline Float fmadd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+	static inline Float fmadd(Float a, Float b, Float c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+	static inline Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+	static inline Float rcp(Float a) { return _mm256_rcp_ps(a); }
+	static inline Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	static inline Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+
+	static inline Mask cmpEq(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	static inline Mask cmpLt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static inline Mask cmpLe(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static inline Mask cmpGt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static inline Mask cmpGe(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+
+	static inline Mask maskAnd(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+	static inline Mask maskOr(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+	static inline Mask maskAndNot(Mask a, Mask b) { return _mm256_andnot_ps(a, b); }
+	static inline Mask maskNot(Mask a) { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+	static inline u32  maskBits(Mask a) { return (u32)_mm256_movemask_ps(a); }
+
+	static inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); }
+
+	static inline Int   set1i(int v) { return _mm256_set1_epi32(v); }
+	static inline Int   mini(Int a, Int b) { return _mm256_min_epi32(a, b); }
+	static inline Int   maxi(Int a, Int b) { return _mm256_max_epi32(a, b); }
+	static inline Int   increment(Int a, Mask m) { return _mm256_sub_epi32(a, _mm256_castps_si256(m)); }
+	static inline Int   truncate(Float a) { return _mm256_cvttps_epi32(a); }
+	static inline Float toFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+	static inline void  storei(int* p, Int v) { _mm256_store_si256((__m256i*)p, v); }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct SimdAvx512
+{
+	typedef __m512    Float;
+	typedef __m512i   Int;
+	typedef __mmask16 Mask;
+
+	static constexpr u32 Width = 16;
+
+	static inline Float zero() { return _mm512_setzero_ps(); }
+	static inline Float set1(float v) { return _mm512_set1_ps(v); }
+	static inline Float load(const float* p) { return _mm512_load_ps(p); }
+	static inline Float loadu(const float* p) { return _mm512_loadu_ps(p); }
+	static inline void  store(float* p, Float v) { _mm512_store_ps(p, v); }
+	static inline void  storeu(float* p, Float v) { _mm512_storeu_ps(p, v); }
+
+	static inline Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+	static inline Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+	static inline Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+	static inline Float div(Float a, Float b) { return _mm512_div_ps(a, b); }
+	static inline Float fmadd(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }
+	static inline Float sqrt(Float a) { return _mm512_sqrt_ps(a); }
+	static inline Float rcp(Float a) // same approximation as the other backends, rather than the more precise rcp14
+	{
+		const __m256 lo = _mm256_rcp_ps(_mm512_castps512_ps256(a));
+		const __m256 hi = _mm256_rcp_ps(_mm512_extractf32x8_ps(a, 1));
+		return _mm512_insertf32x8(_mm512_castps256_ps512(lo), hi, 1);
+	}
+	static inline Float min(Float a, Float b) { return _mm512_min_ps(a, b); }
+	static inline Float max(Float a, Float b) { return _mm512_max_ps(a, b); }
+
+	static inline Mask cmpEq(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+	static inline Mask cmpLt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static inline Mask cmpLe(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static inline Mask cmpGt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static inline Mask cmpGe(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+
+	static inline Mask maskAnd(Mask a, Mask b) { return Mask(a & b); }
+	static inline Mask maskOr(Mask a, Mask b) { return Mask(a | b); }
+	static inline Mask maskAndNot(Mask a, Mask b) { return Mask(~a & b); }
+	static inline Mask maskNot(Mask a) { return Mask(~a); }
+	static inline u32  maskBits(Mask a) { return u32(a); }
+
+	static inline Float select(Mask m, Float a, Float b) { return _mm512_mask_blend_ps(m, b, a); }
+
+	static inline Int   set1i(int v) { return _mm512_set1_epi32(v); }
+	static inline Int   mini(Int a, Int b) { return _mm512_min_epi32(a, b); }
+	static inline Int   maxi(Int a, Int b) { return _mm512_max_epi32(a, b); }
+	static inline Int   increment(Int a, Mask m) { return _mm512_mask_add_epi32(a, m, a, _mm512_set1_epi32(1)); }
+	static inline Int   truncate(Float a) { return _mm512_cvttps_epi32(a); }
+	static inline Float toFloat(Int a) { return _mm512_cvtepi32_ps(a); }
+	static inline void  storei(int* p, Int v) { _mm512_store_si512(p, v); }
+};
+#endif
+
+} // namespace
@@ -1,4 +1,5 @@
 #include "TiledLightTreeBuilder.h"
+#include "OcclusionCulling.h"
 #include "Utils.h"
 
 #include <Rush/UtilTimer.h>
@@ -84,50 +85,28 @@ const LightTreeLutItem* getLightTreeLut(u32 index)
 TiledLightTreeBuilder::TiledLightTreeBuilder(u32 maxLights)
 : m_maxLights(maxLights), m_lightIntervals(maxLights), m_lightScreenSpaceExtents(maxLights)
 {
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = 0;
-		bufferDesc.stride = 4;
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_R16_Uint;
-		m_lightIndexBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+}
 
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = m_maxLights;
-		bufferDesc.stride = (u32)sizeof(PackedLightTreeNode);
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_Unknown;
-		m_lightTreeBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+// Radix sort only moves center keys and interval indices, intervals themselves are gathered once at the end
+void TiledLightTreeBuilder::sortLightIntervalsByCenter()
+{
+	const u32 count = (u32)m_lightIntervals.size();
 
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = 0;
-		bufferDesc.stride = (u32)sizeof(LightGridCell);
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_Unknown;
-		m_lightTileInfoBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+	m_lightIntervalSortKeys.resize(count);
+	m_lightIntervalSortIndices.resize(count);
+	m_lightIntervalsTemp.resize(count);
 
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = 0;
-		bufferDesc.stride = (u32)sizeof(LightDepthInterval);
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_Unknown;
-		m_lightDepthIntervalBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+	parallelFor<u32>(0, count, [&](u32 i) {
+		m_lightIntervalSortKeys[i]    = getSortableFloatBits(m_lightIntervals[i].center);
+		m_lightIntervalSortIndices[i] = i;
+		m_lightIntervalsTemp[i]       = m_lightIntervals[i];
+	});
 
-	{
-		GfxBufferDesc bufferDesc;
-		bufferDesc.count  = 0;
-		bufferDesc.stride = (u32)sizeof(u32);
-		bufferDesc.flags  = GfxBufferFlags::Transient | GfxBufferFlags::Storage;
-		bufferDesc.format = GfxFormat_Unknown;
-		m_lightDepthIntervalIndexBuffer = Gfx_CreateBuffer(bufferDesc);
-	}
+	parallelRadixSort(
+	    m_lightIntervalSortKeys.data(), m_lightIntervalSortIndices.data(), count, 32, m_lightIntervalSortBuffers);
+
+	parallelFor<u32>(0, count,
+	    [&](u32 i) { m_lightIntervals[i] = m_lightIntervalsTemp[m_lightIntervalSortIndices[i]]; });
 }
 
 struct DepthInterval
@@ -197,9 +176,11 @@ inline LightTreeInfo buildLightTreeInfo(const TreeBuildParams& params, u32 light
 	return result;
 }
 
+// Light indices of the intervals are written to outLightIndices[lightOffset + i] while leaf depth bounds are computed,
+// so that every interval of the cell is only read once.
 static u32 buildLightTreeBottomUp(const TreeBuildParams& params, const AlignedArray<LightDepthInterval>& intervals,
     const AlignedArray<u16>& intervalIndices, u32 lightOffset, u32 lightCount, PackedLightTreeNode* outDepthFirstTree,
-    u32 debugIndex)
+    u16* outLightIndices, u32 debugIndex)
 {
 	const LightTreeInfo treeInfo = buildLightTreeInfo(params, lightCount);
 
@@ -238,6 +219,7 @@ static u32 buildLightTreeBottomUp(const TreeBuildParams& params, const AlignedAr
 			const LightDepthInterval& interval   = intervals[intervalIndices[lightIndex]];
 			leafNode.depthMin                    = min(leafNode.depthMin, interval.center - interval.radius);
 			leafNode.depthMax                    = max(leafNode.depthMax, interval.center + interval.radius);
+			outLightIndices[lightIndex]          = interval.lightIndex;
 		}
 
 		assignedLights += nodeLightCount;
@@ -310,7 +292,7 @@ static u32 buildLightTreeBottomUp(const TreeBuildParams& params, const AlignedAr
 
 static u32 buildLightTreeBottomUpShallow(const TreeBuildParams& params,
     const AlignedArray<LightDepthInterval>& intervals, const AlignedArray<u16>& intervalIndices, u32 lightOffset,
-    u32 lightCount, ShallowLightTreeNode* outShallowLightTree, u32 debugIndex)
+    u32 lightCount, ShallowLightTreeNode* outShallowLightTree, u16* outLightIndices, u32 debugIndex)
 {
 	const LightTreeInfo treeInfo = buildLightTreeInfo(
 	    params, lightCount); // TODO: use a specialized version of buildLightTreeInfo for shallow tree
@@ -356,6 +338,7 @@ static u32 buildLightTreeBottomUpShallow(const TreeBuildParams& params,
 			const LightDepthInterval& interval   = intervals[intervalIndices[lightIndex]];
 			leafNode.depthMin                    = min(leafNode.depthMin, interval.center - interval.radius);
 			leafNode.depthMax                    = max(leafNode.depthMax, interval.center + interval.radius);
+			outLightIndices[lightIndex]          = interval.lightIndex;
 		}
 
 		assignedLights += nodeLightCount;
@@ -410,21 +393,85 @@ static u32 buildLightTreeBottomUpShallow(const TreeBuildParams& params,
 	return treeInfo.totalNodeCount;
 }
 
-TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
-    const Camera&                                                  camera,
+TiledLightTreeBuildResult TiledLightTreeBuilder::build(const Camera& camera,
     const std::vector<LightSource>&                                viewSpaceLights,
     const TiledLightTreeBuildParams&                               buildParams)
 {
-	RUSH_ASSERT(buildParams.maxLeafNodes <= MaxLeafNodes);
+	TiledLightTreeBuildResult result;
+	Timer                     timer;
+
+	const FrustumPlanes frustum(camera.buildProjMatrix());
+
+	m_gpuLights.clear();
+
+	result.lightCullTime -= timer.time();
+	m_lightSpheres.build(viewSpaceLights);
+	performLightCullingAndComputeDepthIntervals(frustum, m_lightSpheres, m_visibleLightIndices, m_lightIntervals);
+	result.lightCullTime += timer.time();
+
+	buildFromLightIntervals(camera, viewSpaceLights, buildParams, timer, result);
+
+	return result;
+}
+
+TiledLightTreeBuildResult TiledLightTreeBuilder::build(const Camera& camera,
+    const Mat4&                                                    matView,
+    const std::vector<AnimatedLightSource>&                        worldSpaceLights,
+    u32                                                            lightCount,
+    const TiledLightTreeBuildParams&                               buildParams)
+{
+	TiledLightTreeBuildResult result;
+	Timer                     timer;
+
+	const FrustumPlanes worldSpaceFrustum(matView * camera.buildProjMatrix());
+
+	lightCount = min<u32>(lightCount, (u32)worldSpaceLights.size());
+
+	result.lightCullTime -= timer.time();
+	performLightCullingAndTransform(worldSpaceFrustum, matView, worldSpaceLights.data(), lightCount,
+	    m_visibleLightIndices, m_lightIntervals, m_gpuLights);
+	result.lightCullTime += timer.time();
+
+	buildFromLightIntervals(camera, m_gpuLights, buildParams, timer, result);
+
+	return result;
+}
+
+TiledLightTreeBuildResult TiledLightTreeBuilder::build(const Camera& camera,
+    const Mat4&                                                    matView,
+    const std::vector<AnimatedLightSource>&                        worldSpaceLights,
+    const LightBvh&                                                lightBvh,
+    const TiledLightTreeBuildParams&                               buildParams)
+{
+	RUSH_ASSERT(lightBvh.getLightCount() <= worldSpaceLights.size());
 
 	TiledLightTreeBuildResult result;
 	Timer                     timer;
 
+	const FrustumPlanes worldSpaceFrustum(matView * camera.buildProjMatrix());
+
+	result.lightCullTime -= timer.time();
+	lightBvh.cull(worldSpaceFrustum, m_visibleLightIndices);
+	transformVisibleLights(matView, worldSpaceLights.data(), m_visibleLightIndices, m_lightIntervals, m_gpuLights);
+	result.lightCullTime += timer.time();
+
+	buildFromLightIntervals(camera, m_gpuLights, buildParams, timer, result);
+
+	return result;
+}
+
+void TiledLightTreeBuilder::buildFromLightIntervals(const Camera& camera,
+    const std::vector<LightSource>&                               viewSpaceLights,
+    const TiledLightTreeBuildParams&                              buildParams,
+    Timer&                                                        timer,
+    TiledLightTreeBuildResult&                                    result)
+{
+	RUSH_ASSERT(buildParams.maxLeafNodes <= MaxLeafNodes);
+
 	const auto& resolution = buildParams.resolution;
 	const u32   tileSize   = buildParams.tileSize;
 
-	const Vec2           resolutionF = Vec2((float)resolution.x, (float)resolution.y);
-	const GfxCapability& caps        = Gfx_GetCapability();
+	const Vec2 resolutionF = Vec2((float)resolution.x, (float)resolution.y);
 
 	const Mat4 matProj = camera.buildProjMatrix();
 
@@ -435,21 +482,26 @@ TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
 	const float maxSliceDepth = buildParams.maxSliceDepth;
 	const u32   sliceCount    = buildParams.sliceCount;
 
-	const Frustum frustum(matProj);
-	const Vec3    cameraPosition = camera.getPosition();
-	const Vec3    cameraForward  = camera.getForward();
+	const Vec3 cameraPosition = camera.getPosition();
+	const Vec3 cameraForward  = camera.getForward();
 
-	m_lightIntervals.clear();
 	m_lightScreenSpaceExtents.m_count = viewSpaceLights.size();
 
-	result.lightCullTime -= timer.time();
-	performLightCullingAndComputeDepthIntervals(frustum, viewSpaceLights, m_visibleLightIndices, m_lightIntervals);
-	result.lightCullTime += timer.time();
+	if (buildParams.occlusionBuffer)
+	{
+		result.lightCullTime -= timer.time();
+		cullOccludedLights(*buildParams.occlusionBuffer, viewSpaceLights, m_lightIntervals, m_lightIntervalsTemp);
+		result.lightCullTime += timer.time();
+	}
+
+	result.visibleLightCount = (u32)m_lightIntervals.size();
 
 	// light intervals only need to be sorted once
-	// trees for all tiles can be built assuming pre-sorted data
+	// binning preserves interval order, so trees for all tiles can be built assuming pre-sorted data
 
-	result.visibleLightCount = (u32)m_lightIntervals.size();
+	result.lightSortTime -= timer.time();
+	sortLightIntervalsByCenter();
+	result.lightSortTime += timer.time();
 
 	// assign lights to tiles
 
@@ -470,95 +522,52 @@ TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
 	m_lightGrid.m_count = totalCellCount;
 	memset(m_lightGrid.data(), 0, sizeof(LightGridCell) * totalCellCount);
 
-	m_cellLightCount.clear();
-	m_cellLightCount.resize(totalCellCount, 0);
-
 	alignas(16) Mat4 matProjScreenSpace =
 	    matProj * Mat4::scaleTranslate(Vec3(0.5f * resolutionF.x, -0.5f * resolutionF.y, 1.0f),
 	                  Vec3(0.5f * resolutionF.x, 0.5f * resolutionF.y, 0.0f));
 
-	const u32 totalBinnedLightCount =
-	    performLightBinning(depthExtentsCalculator, matProjScreenSpace, cameraNearZ, buildParams.tileSize, tileCountX,
-	        tileCountY, viewSpaceLights, m_lightIntervals, m_lightScreenSpaceExtents.data(), m_cellLightCount.data());
-
-	m_tileLightCount.clear();
-	m_tileLightCount.resize(tilesPerSlice);
-
-	if (buildParams.calculateTileLightCount)
-	{
-		for (size_t cellIndex = 0; cellIndex < m_lightGrid.size(); ++cellIndex)
-		{
-			u32 cellX = (cellIndex % tilesPerSlice) % tileCountX;
-			u32 cellY = (cellIndex % tilesPerSlice) / tileCountX;
+	m_tileFrustumCache.build(
+	    camera.getFov(), camera.getAspect(), buildParams.tileSize, tileCountX, tileCountY, buildParams.resolution.x);
 
-			u32 tileIndex = cellX + cellY * tileCountX;
-
-			m_tileLightCount[tileIndex] += m_cellLightCount[cellIndex];
-		}
-	}
+	const u32 totalBinnedLightCount = m_lightBinning.count(depthExtentsCalculator, matProjScreenSpace, cameraNearZ,
+	    buildParams.tileSize, tileCountX, tileCountY, sliceCount, viewSpaceLights, m_lightIntervals,
+	    m_lightScreenSpaceExtents.data(), buildParams.useTileFrustumCulling ? &m_tileFrustumCache : nullptr,
+	    buildParams.tileDepthRanges, nullptr, buildParams.useTileRowSpans, false);
 
 	m_tileIntervalIndices.resize(totalBinnedLightCount);
-	m_tileIntervalIndicesSorted.resize(totalBinnedLightCount);
-
-	u32 assignedLightCount = 0;
-	for (size_t cellIndex = 0; cellIndex < totalCellCount; ++cellIndex)
-	{
-		LightGridCell& cell        = m_lightGrid[cellIndex];
-		cell.lightOffset           = assignedLightCount;
-		u32 conservativeLightCount = m_cellLightCount[cellIndex];
-		assignedLightCount += m_cellLightCount[cellIndex];
-
-		cell.lightCount = 0; // to be filled when we scatter lights
-	}
 
-	// copy light intervals into tiles (making this parallel is not a win due to interlocked ops)
-	// additionally, the order of intervals must be preserved
+	// copy light intervals into tiles, the order of intervals is preserved within each cell
 
-	const float yHeight                    = tan(camera.getFov() / 2) * 2;
-	const float xWidth                     = yHeight * camera.getAspect();
-	const Vec2  cameraFrustumTopLeftCorner = Vec2(-xWidth / 2, yHeight / 2);
-	const float tileFrustumStepSize        = xWidth * float(buildParams.tileSize) / float(buildParams.resolution.x);
-	const Vec2  tileStep                   = Vec2(tileFrustumStepSize, -tileFrustumStepSize);
+	m_lightBinning.scatter(m_lightIntervals, m_lightScreenSpaceExtents.data(), m_tileIntervalIndices.data(),
+	    [](u32 intervalIndex) { return (u16)intervalIndex; });
 
-	m_tileFrustumCache.build(
-	    camera.getFov(), camera.getAspect(), buildParams.tileSize, tileCountX, tileCountY, buildParams.resolution.x);
+	if (buildParams.maxLightsPerCell)
+	{
+		computeLightImportance(viewSpaceLights, m_lightIntervals, m_lightImportance);
 
-	parallelForEach(m_lightIntervals.begin(), m_lightIntervals.end(), [&](const LightDepthInterval& interval) {
-		const u64 intervalIndex = &interval - m_lightIntervals.data();
+		const LightCapStats capStats = m_lightBinning.capCells(m_tileIntervalIndices.data(),
+		    buildParams.maxLightsPerCell,
+		    [&](u16 intervalIndex) { return m_lightImportance[m_lightIntervals[intervalIndex].lightIndex]; });
 
-		const LightTileDepthExtents&       depthExtents       = interval.depthExtents;
-		const LightTileScreenSpaceExtents& screenSpaceExtents = m_lightScreenSpaceExtents[interval.lightIndex];
+		m_tileIntervalIndices.resize(m_lightBinning.getCellOffset(totalCellCount));
 
-		const LightSource& light        = viewSpaceLights[interval.lightIndex];
-		const Vec4         lightSphere  = Vec4(light.position, light.attenuationEnd);
-		const Vec2 tileSpaceLightCenter = screenSpaceExtents.screenSpaceBox.center() / float(buildParams.tileSize);
+		result.cappedLightCount = capStats.removedCount;
+		result.cappedImportance = capStats.getRemovedImportanceRatio();
+	}
 
-		for (u32 y = screenSpaceExtents.tileMin.y; y <= screenSpaceExtents.tileMax.y; ++y)
-		{
-			for (u32 x = screenSpaceExtents.tileMin.x; x <= screenSpaceExtents.tileMax.x; ++x)
-			{
-				if (buildParams.useTileFrustumCulling)
-				{
-					u32         tileId  = x + y * tileCountX;
-					const Vec3* corners = &m_tileFrustumCache.m_corners[tileId * 4];
-					const Vec3* planes  = &m_tileFrustumCache.m_planes[tileId * 4];
+	m_tileLightCount.clear();
+	m_tileLightCount.resize(tilesPerSlice);
 
-					if (!testTileFrustumSphere(corners, planes, lightSphere))
-					{
-						continue;
-					}
-				}
+	if (buildParams.calculateTileLightCount)
+	{
+		parallelFor<u32>(0, tilesPerSlice,
+		    [&](u32 tileIndex) { m_tileLightCount[tileIndex] = (u16)m_lightBinning.getTileLightCount(tileIndex); });
+	}
 
-				for (u32 z = depthExtents.sliceMin; z <= depthExtents.sliceMax; ++z)
-				{
-					u32   cellIndex  = x + y * tileCountX + z * tilesPerSlice;
-					auto& cell       = m_lightGrid[cellIndex];
-					u16   writeIndex = interlockedIncrement(cell.lightCount) - 1;
-					u16*  writePtr   = &m_tileIntervalIndices[cell.lightOffset] + writeIndex;
-					*writePtr        = (u16)intervalIndex;
-				}
-			}
-		}
+	parallelFor<u32>(0, totalCellCount, [&](u32 cellIndex) {
+		LightGridCell& cell = m_lightGrid[cellIndex];
+		cell.lightOffset    = m_lightBinning.getCellOffset(cellIndex);
+		cell.lightCount     = m_lightBinning.getCellLightCount(cellIndex);
 	});
 
 	result.lightAssignTime += timer.time();
@@ -567,22 +576,11 @@ TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
 
 	// build the per-tile trees
 
-	m_gpuLights.clear();
 	m_gpuLightTree.clear();
 	m_gpuLightTreeShallow.clear();
 	m_gpuLightIndices.clear();
 
-	if (buildParams.useShallowTree)
-	{
-		m_gpuLightTreeShallow.reserve((m_lightIntervals.size() * 4) / 3);
-	}
-	else
-	{
-		m_gpuLightTree.reserve((m_lightIntervals.size() * 4) / 3);
-	}
-
 	m_gpuLightIndices.resize(m_tileIntervalIndices.size());
-	m_gpuLightTree.reserve((m_lightIntervals.size() * 4) / 3);
 
 	auto computeSliceDepth = [&](u32 slice) {
 		if (slice == 0)
@@ -594,218 +592,186 @@ TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
 		           : computeLinearSliceDepth(slice, buildParams.maxSliceDepth, buildParams.sliceCount);
 	};
 
-	m_treeBuildQueue.clear();
-	m_treeBuildQueue.reserve(totalCellCount);
-
 	TreeBuildParams treeBuildParams;
 	treeBuildParams.minLightsPerLeaf = buildParams.targetLightsPerLeaf;
 	treeBuildParams.maxLeafNodes     = buildParams.maxLeafNodes;
 
-	u32 copiedGpuLightCount = 0;
+	struct SliceInfo
+	{
+		float depthMin;
+		float depthMax;
+		float treeHeuristicExtentsThreshold;
+	};
 
+	std::vector<SliceInfo> sliceInfos(sliceCount);
 	for (u32 z = 0; z < sliceCount; ++z)
 	{
-		const float sliceDepthMin    = computeSliceDepth(z);
-		const float sliceDepthMax    = computeSliceDepth(z + 1);
-		const float sliceDepthExtent = sliceDepthMax - sliceDepthMin;
+		SliceInfo& slice = sliceInfos[z];
+		slice.depthMin   = computeSliceDepth(z);
+		slice.depthMax   = computeSliceDepth(z + 1);
+
+		const float sliceDepthExtent = slice.depthMax - slice.depthMin;
 
-		const float treeHeuristicExtentsThreshold =
+		slice.treeHeuristicExtentsThreshold =
 		    buildParams.useClippedLightExtents ? sliceDepthExtent * buildParams.lightTreeHeuristic * 0.5f // use radius
 		                                       : sliceDepthExtent * buildParams.lightTreeHeuristic; // use diameter
+	}
 
-		for (u32 y = 0; y < tileCountY; ++y)
-		{
-			for (u32 x = 0; x < tileCountX; ++x)
-			{
-				u32            cellIndex = x + y * tileCountX + z * tilesPerSlice;
-				LightGridCell& cell      = m_lightGrid[cellIndex];
+	// Cells are classified and their node counts are computed in parallel. Node offsets are then assigned by a scan in
+	// cell order, after which all lists and trees can be written by a single parallel pass.
 
-				const u32 cellLightCount = cell.lightCount;
+	static constexpr u32 CellsPerTask = 1024;
 
-				if (cellLightCount == 0)
-				{
-					continue;
-				}
+	m_cellTypes.resize(totalCellCount);
 
-				bool useLightList = !buildParams.useShallowTree;
+	auto classifyCells = [&](auto shallowTreeFlag, auto clippedLightExtentsFlag) {
+		constexpr bool UseShallowTree         = decltype(shallowTreeFlag)::value;
+		constexpr bool UseClippedLightExtents = decltype(clippedLightExtentsFlag)::value;
 
-				if (cellLightCount > (u32)buildParams.targetLightsPerLeaf)
-				{
-					float lightExtentsSum = 0.0f;
-					for (u32 lightIt = 0; lightIt < cellLightCount; ++lightIt)
-					{
-						u32                       tileIntervalIndex   = lightIt + cell.lightOffset;
-						u32                       globalIntervalIndex = m_tileIntervalIndices[tileIntervalIndex];
-						const LightDepthInterval& interval            = m_lightIntervals[globalIntervalIndex];
-
-						if (buildParams.useClippedLightExtents)
-						{
-							float lightDepthMin = max(interval.center - interval.radius, sliceDepthMin);
-							float lightDepthMax = min(interval.center + interval.radius, sliceDepthMax);
-							lightExtentsSum += lightDepthMax - lightDepthMin;
-						}
-						else
-						{
-							lightExtentsSum += interval.radius * 2;
-						}
-					}
+		parallelFor<u32>(0, totalCellCount, [&](u32 cellIndex) {
+			LightGridCell& cell = m_lightGrid[cellIndex];
 
-					float averageLightExtents = lightExtentsSum / cellLightCount;
+			const u32 cellLightCount = cell.lightCount;
 
-					if (averageLightExtents <= treeHeuristicExtentsThreshold)
-					{
-						useLightList = false;
-					}
-				}
+			if (cellLightCount == 0)
+			{
+				m_cellTypes[cellIndex] = CellType::Empty;
+				return;
+			}
 
-				if (useLightList)
-				{
-					LightTreeNode node;
-					node.depthMin    = -FLT_MAX / 2.0f;
-					node.depthMax    = FLT_MAX / 2.0f;
-					node.lightOffset = cell.lightOffset;
-					node.lightCount  = cellLightCount;
-					node.left        = ~0u;
-					node.right       = ~0u;
-					node.isLeaf      = 1;
-					node.next        = ~0u;
-
-					cell.treeNodeCount = 1;
-					cell.treeOffset = (u32)m_gpuLightTree.size();
-					m_gpuLightTree.push_back(packNode(node, 0));
-
-					for (u32 i = 0; i < cellLightCount; ++i)
-					{
-						u32                       tileIntervalIndex   = i + cell.lightOffset;
-						u32                       globalIntervalIndex = m_tileIntervalIndices[tileIntervalIndex];
-						const LightDepthInterval& interval            = m_lightIntervals[globalIntervalIndex];
+			const SliceInfo& slice = sliceInfos[cellIndex / tilesPerSlice];
 
-						m_gpuLightIndices[cell.lightOffset + i] = interval.lightIndex;
-					}
+			bool useLightList = !UseShallowTree;
 
-					result.listCellCount++;
-				}
-				else
+			if (cellLightCount > (u32)buildParams.targetLightsPerLeaf)
+			{
+				float lightExtentsSum = 0.0f;
+				for (u32 lightIt = 0; lightIt < cellLightCount; ++lightIt)
 				{
-					LightTreeInfo buildInfo = buildLightTreeInfo(treeBuildParams, cellLightCount);
-
-					cell.treeNodeCount = buildInfo.totalNodeCount;
+					u32                       tileIntervalIndex   = lightIt + cell.lightOffset;
+					u32                       globalIntervalIndex = m_tileIntervalIndices[tileIntervalIndex];
+					const LightDepthInterval& interval            = m_lightIntervals[globalIntervalIndex];
 
-					if (buildParams.useShallowTree)
+					if (UseClippedLightExtents)
 					{
-						cell.treeOffset = (u32)m_gpuLightTreeShallow.size();
-						m_gpuLightTreeShallow.resize(m_gpuLightTreeShallow.size() + buildInfo.totalNodeCount);
+						float lightDepthMin = max(interval.center - interval.radius, slice.depthMin);
+						float lightDepthMax = min(interval.center + interval.radius, slice.depthMax);
+						lightExtentsSum += lightDepthMax - lightDepthMin;
 					}
 					else
 					{
-						cell.treeOffset = (u32)m_gpuLightTree.size();
-						m_gpuLightTree.resize(m_gpuLightTree.size() + buildInfo.totalNodeCount);
+						lightExtentsSum += interval.radius * 2;
 					}
+				}
 
-					m_treeBuildQueue.push_back(cellIndex);
+				float averageLightExtents = lightExtentsSum / cellLightCount;
 
-					result.treeCellCount++;
+				if (averageLightExtents <= slice.treeHeuristicExtentsThreshold)
+				{
+					useLightList = false;
 				}
-
-				copiedGpuLightCount += cellLightCount;
 			}
-		}
-	}
-
-	result.buildTreeTime += timer.time();
 
-	// Build per-cell trees
-
-	{
-		result.buildTreeTime -= timer.time();
-
-		parallelForEach(m_treeBuildQueue.begin(), m_treeBuildQueue.end(), [&](u32 cellIndex) {
-			const LightGridCell& cell = m_lightGrid[cellIndex];
-
-			u16* idxBegin = &m_tileIntervalIndices[cell.lightOffset];
-			u16* idxEnd   = idxBegin + cell.lightCount;
-
-#if 0
-			// Perfect sorting using std::sort is pretty slow and is not actually required to get good GPU performance.
-			// An approximate radix sort / bucket sort is much faster on CPU and does not noticeably affect GPU.
-			std::sort(idxBegin, idxEnd,
-			    [&](u16 a, u16 b) { return m_lightIntervals[a].center < m_lightIntervals[b].center; });
-
-			for (u32 i = cell.lightOffset; i < cell.lightOffset + cell.lightCount; ++i)
+			if (useLightList)
 			{
-				m_tileIntervalIndicesSorted[i] = m_tileIntervalIndices[i];
+				m_cellTypes[cellIndex] = CellType::LightList;
+				cell.treeNodeCount     = 1;
 			}
-#else
-			// TODO: move the sorting into a function
-			static constexpr u32 BUCKET_COUNT = 512;
-			u16 buckets[BUCKET_COUNT];
-			memset(buckets, 0, sizeof(buckets));
-			float lightDepthMax = 0.0f;
-
-			// TODO: compute max depth during binning
-			for (u32 i = 0; i < cell.lightCount; ++i)
+			else
 			{
-				u16 lightIndex = idxBegin[i];
-				lightDepthMax = max(lightDepthMax, m_lightIntervals[lightIndex].center);
+				m_cellTypes[cellIndex] = CellType::LightTree;
+				cell.treeNodeCount     = buildLightTreeInfo(treeBuildParams, cellLightCount).totalNodeCount;
 			}
+		});
+	};
 
-			// Compute histogram
-			float depthScale = float(BUCKET_COUNT) / lightDepthMax;
+	dispatchFlags(classifyCells, buildParams.useShallowTree, buildParams.useClippedLightExtents);
+
+	const u32 totalNodeCount = parallelExclusiveScan<u32>(
+	    totalCellCount, CellsPerTask, [&](u32 cellIndex) { return m_lightGrid[cellIndex].treeNodeCount; },
+	    [&](u32 cellIndex, u32 offset) {
+		    if (m_lightGrid[cellIndex].treeNodeCount)
+		    {
+			    m_lightGrid[cellIndex].treeOffset = offset;
+		    }
+	    });
+
+	// Number of light tree cells in x and light list cells in y
+	const Tuple2u cellTypeCounts = parallelReduce(totalCellCount, CellsPerTask, Tuple2u{0, 0},
+	    [&](u32 begin, u32 end) {
+		    Tuple2u counts = {0, 0};
+		    for (u32 cellIndex = begin; cellIndex < end; ++cellIndex)
+		    {
+			    counts.x += m_cellTypes[cellIndex] == CellType::LightTree;
+			    counts.y += m_cellTypes[cellIndex] == CellType::LightList;
+		    }
+		    return counts;
+	    },
+	    [](const Tuple2u& a, const Tuple2u& b) { return Tuple2u{a.x + b.x, a.y + b.y}; });
+
+	result.treeCellCount += cellTypeCounts.x;
+	result.listCellCount += cellTypeCounts.y;
 
-			auto computeLightBucket = [depthScale](float depth)
-			{
-				return clamp<int>(int(depthScale * depth), 0, int(BUCKET_COUNT-1));
-			};
+	if (buildParams.useShallowTree)
+	{
+		m_gpuLightTreeShallow.resize(totalNodeCount);
+	}
+	else
+	{
+		m_gpuLightTree.resize(totalNodeCount);
+	}
 
-			for (u32 i = 0; i < cell.lightCount; ++i)
-			{
-				u16 lightIndex = idxBegin[i];
-				int bucketIndex = computeLightBucket(m_lightIntervals[lightIndex].center);
-				buckets[bucketIndex]++;
-			}
+	// Build per-cell lists and trees
+
+	{
+		parallelFor<u32>(0, totalCellCount, [&](u32 cellIndex) {
+			const LightGridCell& cell = m_lightGrid[cellIndex];
 
-			// Perform prefix scan
-			u16 offset = 0;
-			for (u32 i = 0; i < BUCKET_COUNT; ++i)
+			if (m_cellTypes[cellIndex] == CellType::Empty)
 			{
-				u16 temp = buckets[i];
-				buckets[i] = offset;
-				offset += temp;
+				return;
 			}
 
-			// Write out sorted light indices
-			for (u32 i = 0; i < cell.lightCount; ++i)
+			if (m_cellTypes[cellIndex] == CellType::LightList)
 			{
-				u16 lightIndex = idxBegin[i];
-				int bucketIndex = computeLightBucket(m_lightIntervals[lightIndex].center);
-				u32 writeIndex = cell.lightOffset + buckets[bucketIndex];
-				buckets[bucketIndex]++;
-				m_tileIntervalIndicesSorted[writeIndex] = lightIndex;
+				LightTreeNode node;
+				node.depthMin    = -FLT_MAX / 2.0f;
+				node.depthMax    = FLT_MAX / 2.0f;
+				node.lightOffset = cell.lightOffset;
+				node.lightCount  = cell.lightCount;
+				node.left        = ~0u;
+				node.right       = ~0u;
+				node.isLeaf      = 1;
+				node.next        = ~0u;
+
+				m_gpuLightTree[cell.treeOffset] = packNode(node, 0);
+
+				for (u32 i = 0; i < cell.lightCount; ++i)
+				{
+					u32                       tileIntervalIndex   = i + cell.lightOffset;
+					u32                       globalIntervalIndex = m_tileIntervalIndices[tileIntervalIndex];
+					const LightDepthInterval& interval            = m_lightIntervals[globalIntervalIndex];
+
+					m_gpuLightIndices[cell.lightOffset + i] = interval.lightIndex;
+				}
+
+				return;
 			}
-#endif
 
 			if (buildParams.useShallowTree)
 			{
-				buildLightTreeBottomUpShallow(treeBuildParams, m_lightIntervals, m_tileIntervalIndicesSorted,
-				    cell.lightOffset, cell.lightCount, &m_gpuLightTreeShallow[cell.treeOffset], cellIndex);
+				buildLightTreeBottomUpShallow(treeBuildParams, m_lightIntervals, m_tileIntervalIndices,
+				    cell.lightOffset, cell.lightCount, &m_gpuLightTreeShallow[cell.treeOffset], m_gpuLightIndices.data(),
+				    cellIndex);
 			}
 			else
 			{
-				buildLightTreeBottomUp(treeBuildParams, m_lightIntervals, m_tileIntervalIndicesSorted, cell.lightOffset,
-				    cell.lightCount, &m_gpuLightTree[cell.treeOffset], cellIndex);
-			}
-
-			for (u32 i = 0; i < cell.lightCount; ++i)
-			{
-				u32                       tileIntervalIndex   = i + cell.lightOffset;
-				u32                       globalIntervalIndex = m_tileIntervalIndicesSorted[tileIntervalIndex];
-				const LightDepthInterval& interval            = m_lightIntervals[globalIntervalIndex];
-
-				m_gpuLightIndices[cell.lightOffset + i] = interval.lightIndex;
+				buildLightTreeBottomUp(treeBuildParams, m_lightIntervals, m_tileIntervalIndices, cell.lightOffset,
+				    cell.lightCount, &m_gpuLightTree[cell.treeOffset], m_gpuLightIndices.data(), cellIndex);
 			}
 		});
 
-		RUSH_ASSERT(m_gpuLightIndices.size() == m_tileIntervalIndicesSorted.size());
+		RUSH_ASSERT(m_gpuLightIndices.size() == m_tileIntervalIndices.size());
 
 		if (buildParams.useShallowTree)
 		{
@@ -817,11 +783,7 @@ TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
 				m_gpuLightTreeShallow.push_back(dummyNode);
 			}
 
-			{
-				result.uploadTime -= timer.time();
-				result.treeDataSize += updateBufferFromArray(ctx, m_lightTreeBuffer.get(), m_gpuLightTreeShallow);
-				result.uploadTime += timer.time();
-			}
+			result.treeDataSize += u32(m_gpuLightTreeShallow.size() * sizeof(ShallowLightTreeNode));
 		}
 		else
 		{
@@ -833,45 +795,29 @@ TiledLightTreeBuildResult TiledLightTreeBuilder::build(GfxContext* ctx,
 				m_gpuLightTree.push_back(dummyNode);
 			}
 
-			{
-				result.uploadTime -= timer.time();
-				result.treeDataSize += updateBufferFromArray(ctx, m_lightTreeBuffer.get(), m_gpuLightTree);
-				result.uploadTime += timer.time();
-			}
+			result.treeDataSize += u32(m_gpuLightTree.size() * sizeof(PackedLightTreeNode));
 		}
 
 		result.buildTreeTime += timer.time();
 	}
 
-	// Upload light sources, light indices and tile info
+	// Light indices and tile info are submitted to the GPU separately by TiledLightTreeUploader
 	{
-		result.uploadTime -= timer.time();
-
-		result.treeDataSize = updateBufferFromArray(ctx, m_lightTileInfoBuffer.get(), m_lightGrid);
+		result.treeDataSize += u32(m_lightGrid.size() * sizeof(LightGridCell));
 
 		if (m_gpuLightIndices.empty())
 		{
 			m_gpuLightIndices.push_back(0);
 		}
 
-		{
-			static_assert(sizeof(*viewSpaceLights.data()) == sizeof(*m_gpuLights.data()), "");
-			result.lightDataSize += updateBufferFromArray(ctx, m_lightIndexBuffer.get(), m_gpuLightIndices);
-		}
-
-		result.uploadTime += timer.time();
+		static_assert(sizeof(*viewSpaceLights.data()) == sizeof(*m_gpuLights.data()), "");
+		result.lightDataSize += u32(m_gpuLightIndices.size() * sizeof(u16));
 	}
 
-	result.lightTreeBuffer.retain(m_lightTreeBuffer.get());
-	result.lightIndexBuffer.retain(m_lightIndexBuffer.get());
-	result.lightTileInfoBuffer.retain(m_lightTileInfoBuffer.get());
-
 	result.hierarchicalCullingDepthThreshold = maxSliceDepth;
 	result.sliceCount                        = sliceCount;
 
 	result.totalDataSize = result.treeDataSize + result.lightDataSize;
 
 	result.buildTotalTime = timer.time();
-
-	return result;
 }
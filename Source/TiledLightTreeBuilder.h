@@ -1,12 +1,11 @@
 #pragma once
 
-#include "GpuBuffer.h"
+#include "LightBvh.h"
 #include "LightingCommon.h"
-#include "Shader.h"
 
-#include <Rush/GfxCommon.h>
 #include <Rush/MathTypes.h>
 #include <Rush/UtilCamera.h>
+#include <Rush/UtilTimer.h>
 #include <Rush/UtilTuple.h>
 
 #include <vector>
@@ -76,9 +75,8 @@ struct TiledLightTreeBuildResult
 	u32 lightDataSize = 0;
 	u32 treeDataSize  = 0;
 
-	GfxRef<GfxBuffer> lightTreeBuffer;
-	GfxRef<GfxBuffer> lightIndexBuffer;
-	GfxRef<GfxBuffer> lightTileInfoBuffer;
+	u32   cappedLightCount = 0; // cell entries removed by maxLightsPerCell
+	float cappedImportance = 0; // proportion of total importance of cell entries removed by maxLightsPerCell
 };
 
 struct TiledLightTreeBuildParams : CommonLightBuildParams
@@ -103,7 +101,7 @@ struct TreeBuildParams
 
 class TiledLightTreeBuilderBase
 {
-protected:
+public:
 	struct alignas(16) LightGridCell
 	{
 		u32 lightOffset;
@@ -112,7 +110,6 @@ protected:
 		u32 treeNodeCount;
 	};
 
-public:
 	static constexpr u32 MaxBottomUpTreeLevels = 7;
 	static constexpr u32 MaxLeafNodes =
 	    1 << (MaxBottomUpTreeLevels - 1); // Limit tree size something sensible that fits into LDS;
@@ -124,8 +121,13 @@ class TiledLightTreeBuilder : public TiledLightTreeBuilderBase
 public:
 	TiledLightTreeBuilder(u32 maxLights);
 
+	LightSpheresSoA                           m_lightSpheres;
 	AlignedArray<u32>                         m_visibleLightIndices;
-	AlignedArray<LightDepthInterval>          m_lightIntervals;
+	AlignedArray<LightDepthInterval>          m_lightIntervals; // sorted by center
+	AlignedArray<LightDepthInterval>          m_lightIntervalsTemp; // temporary storage for sorting and culling
+	std::vector<u32>                          m_lightIntervalSortKeys;
+	std::vector<u32>                          m_lightIntervalSortIndices;
+	RadixSortBuffers                          m_lightIntervalSortBuffers;
 	AlignedArray<LightTileScreenSpaceExtents> m_lightScreenSpaceExtents;
 	std::vector<LightTreeNode>                m_tempLightTree; // temporary tree
 	std::vector<PackedLightTreeNode>          m_gpuLightTree; // binary
@@ -133,28 +135,53 @@ public:
 	std::vector<LightSource>                  m_gpuLights;
 	std::vector<u16>                          m_gpuLightIndices;
 
-	GfxOwn<GfxBuffer> m_lightIndexBuffer;
-	GfxOwn<GfxBuffer> m_lightTreeBuffer;
-	GfxOwn<GfxBuffer> m_lightTileInfoBuffer;
-
-	GfxOwn<GfxBuffer> m_lightDepthIntervalBuffer;
-	GfxOwn<GfxBuffer> m_lightDepthIntervalIndexBuffer;
-
 	AlignedArray<LightGridCell> m_lightGrid;
 	AlignedArray<u16>           m_tileIntervalIndices;
-	AlignedArray<u16>           m_tileIntervalIndicesSorted;
 
-	std::vector<u16> m_cellLightCount;
-	std::vector<u16> m_tileLightCount;
+	LightBinning       m_lightBinning;
+	std::vector<u16>   m_tileLightCount;
+	std::vector<float> m_lightImportance; // only computed if maxLightsPerCell is set
+
+	enum class CellType : u8
+	{
+		Empty,
+		LightList,
+		LightTree,
+	};
 
-	std::vector<u32> m_treeBuildQueue;
+	std::vector<CellType> m_cellTypes;
 
 	const u32 m_maxLights;
 
 	TileFrustumCache m_tileFrustumCache;
 
-	TiledLightTreeBuildResult build(GfxContext* ctx,
-	    const Camera&                           camera,
-	    const std::vector<LightSource>&         viewSpaceLights,
-	    const TiledLightTreeBuildParams&        buildParams);
+	// Performs all CPU work and leaves the results in m_gpuLightTree / m_gpuLightTreeShallow, m_lightGrid and
+	// m_gpuLightIndices. Use TiledLightTreeUploader to submit them to the GPU.
+	TiledLightTreeBuildResult build(const Camera& camera,
+	    const std::vector<LightSource>&           viewSpaceLights,
+	    const TiledLightTreeBuildParams&          buildParams);
+
+	// Same as above, but takes world space lights and only transforms the ones that pass frustum culling.
+	// View space copies of visible lights are left in m_gpuLights, which light intervals index into.
+	TiledLightTreeBuildResult build(const Camera& camera,
+	    const Mat4&                               matView,
+	    const std::vector<AnimatedLightSource>&   worldSpaceLights,
+	    u32                                       lightCount,
+	    const TiledLightTreeBuildParams&          buildParams);
+
+	// Same as above, but visible lights are found by walking a BVH built over worldSpaceLights.
+	TiledLightTreeBuildResult build(const Camera& camera,
+	    const Mat4&                               matView,
+	    const std::vector<AnimatedLightSource>&   worldSpaceLights,
+	    const LightBvh&                           lightBvh,
+	    const TiledLightTreeBuildParams&          buildParams);
+
+private:
+	void sortLightIntervalsByCenter();
+
+	void buildFromLightIntervals(const Camera& camera,
+	    const std::vector<LightSource>&        viewSpaceLights,
+	    const TiledLightTreeBuildParams&       buildParams,
+	    Timer&                                 timer,
+	    TiledLightTreeBuildResult&             result);
 };
@@ -1,11 +1,13 @@
 #pragma once
 
-#include <Rush/GfxDevice.h>
 #include <Rush/MathTypes.h>
 #include <Rush/UtilFile.h>
 
 #include <new>
+#include <string.h>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #if defined(_MSC_VER) || defined(__SSE__)
 #include <xmmintrin.h>
@@ -65,6 +67,32 @@ template <typename T> static void readContainer(DataStream& stream, std::vector<
 bool        endsWith(const std::string& value, const std::string& suffix);
 std::string directoryFromFilename(const std::string& filename);
 
+// Returns true if the CPU supports SSE4.1 instructions
+bool isSse41Supported();
+
+// Returns true if the CPU and OS support AVX2 and FMA instructions
+bool isAvx2Supported();
+
+// Returns true if the CPU and OS support AVX-512 F, DQ, CD, BW and VL instructions, as well as AVX2 and FMA
+bool isAvx512Supported();
+
+// Calls f with a std::integral_constant<bool> argument for each of the flags, in the same order. Kernels written as
+// generic lambdas are instantiated for every combination of the flags and can branch on them at compile time, e.g.
+// dispatchFlags([&](auto useA, auto useB) { kernel<decltype(useA)::value, decltype(useB)::value>(); }, a, b);
+template <typename F> inline void dispatchFlags(F&& f) { f(); }
+
+template <typename F, typename... Flags> inline void dispatchFlags(F&& f, bool flag, Flags... flags)
+{
+	if (flag)
+	{
+		dispatchFlags([&](auto... rest) { f(std::true_type(), rest...); }, flags...);
+	}
+	else
+	{
+		dispatchFlags([&](auto... rest) { f(std::false_type(), rest...); }, flags...);
+	}
+}
+
 #define USE_PARALLEL_ALGORITHMS 1
 
 inline enki::TaskScheduler* getTaskScheduler()
@@ -129,6 +157,259 @@ inline void parallelForEach(I begin, I end, F fun)
 #endif // USE_PARALLEL_ALGORITHMS
 }
 
+// Range [0, count) split into chunks of at least grainSize elements, used by the parallel algorithms below.
+// Chunks get larger for big ranges, so that there are never more than maxChunkCount of them and per-chunk results
+// can be kept in fixed size arrays.
+struct ChunkedRange
+{
+	static constexpr u32 MaxChunkCount = 1024;
+
+	ChunkedRange(u32 elementCount, u32 grainSize, u32 maxChunkCount = MaxChunkCount)
+	: count(elementCount)
+	, chunkSize(max(max(grainSize, 1u), divUp(elementCount, maxChunkCount)))
+	, chunkCount(divUp(elementCount, chunkSize))
+	{
+	}
+
+	// Calls fun(chunkIndex, begin, end) for every chunk in parallel
+	template <typename F> void forEachChunk(F fun) const
+	{
+		parallelFor<u32>(0, chunkCount, [&](u32 chunkIndex) {
+			const u32 begin = chunkIndex * chunkSize;
+			const u32 end   = min(begin + chunkSize, count);
+			fun(chunkIndex, begin, end);
+		});
+	}
+
+	// Replaces per-chunk values with the sum of values of all previous chunks and returns the sum of all of them
+	template <typename T> T scanChunkValues(T* chunkValues) const
+	{
+		T total = T(0);
+		for (u32 chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+		{
+			const T chunkValue      = chunkValues[chunkIndex];
+			chunkValues[chunkIndex] = total;
+			total += chunkValue;
+		}
+		return total;
+	}
+
+	u32 count;
+	u32 chunkSize;
+	u32 chunkCount;
+};
+
+// Parallel reduction over range [0, count), which is split into chunks of at least grainSize elements.
+// reduceRange(begin, end) must return the reduction of a chunk. Chunk results are combined in order using
+// combine(a, b), starting from identity, so the result does not depend on scheduling.
+template <typename T, typename ReduceFunction, typename CombineFunction>
+inline T parallelReduce(u32 count, u32 grainSize, T identity, ReduceFunction reduceRange, CombineFunction combine)
+{
+	const ChunkedRange chunks(count, grainSize);
+
+	T chunkResults[ChunkedRange::MaxChunkCount];
+
+	chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) { chunkResults[chunkIndex] = reduceRange(begin, end); });
+
+	T result = identity;
+	for (u32 chunkIndex = 0; chunkIndex < chunks.chunkCount; ++chunkIndex)
+	{
+		result = combine(result, chunkResults[chunkIndex]);
+	}
+
+	return result;
+}
+
+// Parallel exclusive prefix sum over range [0, count), which is split into chunks of at least grainSize elements.
+// getValue(i) returns the i-th input and setOffset(i, offset) receives the sum of all inputs before it.
+// Chunk sums are computed in the first pass, scanned serially and then used as starting offsets in the second pass.
+// Inputs are not stored in between, so getValue() is called twice per element and must be cheap and return the same
+// value both times. setOffset(i, offset) must not change inputs of other elements.
+// Returns the sum of all inputs.
+template <typename T, typename GetFunction, typename SetFunction>
+inline T parallelExclusiveScan(u32 count, u32 grainSize, GetFunction getValue, SetFunction setOffset)
+{
+	const ChunkedRange chunks(count, grainSize);
+
+	T chunkOffsets[ChunkedRange::MaxChunkCount];
+
+	chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) {
+		T sum = T(0);
+		for (u32 i = begin; i < end; ++i)
+		{
+			sum += getValue(i);
+		}
+		chunkOffsets[chunkIndex] = sum;
+	});
+
+	const T total = chunks.scanChunkValues(chunkOffsets);
+
+	chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) {
+		T offset = chunkOffsets[chunkIndex];
+		for (u32 i = begin; i < end; ++i)
+		{
+			const T value = getValue(i);
+			setOffset(i, offset);
+			offset += value;
+		}
+	});
+
+	return total;
+}
+
+// In-place version of the above
+template <typename T> inline T parallelExclusiveScan(T* data, u32 count, u32 grainSize)
+{
+	return parallelExclusiveScan<T>(
+	    count, grainSize, [data](u32 i) { return data[i]; }, [data](u32 i, T offset) { data[i] = offset; });
+}
+
+// Two-pass parallel stream compaction.
+// Range [0, count) is split into chunks of at least grainSize elements. countRange(begin, end) must return the number
+// of output elements produced by the chunk and scatterRange(begin, end, writeOffset) must write them starting at
+// writeOffset. Chunk offsets are computed with a prefix sum between the passes, so the output order is the same as
+// the input order and no shared counters are used. Returns the total number of output elements.
+template <typename CountFunction, typename ScatterFunction>
+inline u32 parallelCompact(u32 count, u32 grainSize, CountFunction countRange, ScatterFunction scatterRange)
+{
+	const ChunkedRange chunks(count, grainSize);
+
+	u32 chunkOffsets[ChunkedRange::MaxChunkCount];
+
+	chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) { chunkOffsets[chunkIndex] = countRange(begin, end); });
+
+	const u32 outputCount = chunks.scanChunkValues(chunkOffsets);
+
+	chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) { scatterRange(begin, end, chunkOffsets[chunkIndex]); });
+
+	return outputCount;
+}
+
+// Maps float bits to an unsigned integer with the same ordering, so that floats can be used as radix sort keys
+inline u32 getSortableFloatBits(float f)
+{
+	u32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits ^ (u32(s32(bits) >> 31) | 0x80000000);
+}
+
+// Temporary storage of parallelRadixSort(), which can be kept between calls to avoid allocations
+struct RadixSortBuffers
+{
+	std::vector<u32> keys;
+	std::vector<u32> values;
+	std::vector<u32> histograms;
+};
+
+// Stable parallel LSD radix sort of keys and their values (e.g. indices of the sorted items) in place.
+// Keys must be less than 2^keyBits. Large arrays use up to 11 bits per pass to minimize passes over the data, while
+// smaller ones use up to 8 bits, so that clearing and scanning histograms does not dominate. Passes where all keys
+// share the same digit are skipped.
+// Each pass counts digits of chunks of the input, then offsets are assigned in digit order and chunk order, so that
+// chunks can scatter their items in parallel without atomics. Tiny arrays are insertion sorted instead.
+inline void parallelRadixSort(u32* keys, u32* values, u32 count, u32 keyBits, RadixSortBuffers& buffers)
+{
+	static constexpr u32 InsertionSortCount = 64;
+	static constexpr u32 LargeArrayCount    = 131072;
+	static constexpr u32 MaxChunkCount      = 64;
+	static constexpr u32 MinGrainSize       = 4096;
+
+	RUSH_ASSERT(keyBits >= 1 && keyBits <= 32);
+
+	if (count <= InsertionSortCount)
+	{
+		for (u32 i = 1; i < count; ++i)
+		{
+			const u32 key   = keys[i];
+			const u32 value = values[i];
+
+			u32 j = i;
+			for (; j > 0 && keys[j - 1] > key; --j)
+			{
+				keys[j]   = keys[j - 1];
+				values[j] = values[j - 1];
+			}
+
+			keys[j]   = key;
+			values[j] = value;
+		}
+
+		return;
+	}
+
+	const u32 passCount  = divUp(keyBits, count >= LargeArrayCount ? 11u : 8u);
+	const u32 digitBits  = divUp(keyBits, passCount);
+	const u32 digitCount = 1u << digitBits;
+	const u32 digitMask  = digitCount - 1;
+
+	const ChunkedRange chunks(count, MinGrainSize, MaxChunkCount);
+
+	buffers.keys.resize(count);
+	buffers.values.resize(count);
+	buffers.histograms.resize(chunks.chunkCount * digitCount);
+
+	u32* srcKeys   = keys;
+	u32* srcValues = values;
+	u32* dstKeys   = buffers.keys.data();
+	u32* dstValues = buffers.values.data();
+
+	for (u32 pass = 0; pass < passCount; ++pass)
+	{
+		const u32 shift = pass * digitBits;
+
+		chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) {
+			u32* histogram = &buffers.histograms[chunkIndex * digitCount];
+			memset(histogram, 0, sizeof(u32) * digitCount);
+
+			for (u32 i = begin; i < end; ++i)
+			{
+				histogram[(srcKeys[i] >> shift) & digitMask]++;
+			}
+		});
+
+		bool uniformDigit = false;
+		u32  offset       = 0;
+		for (u32 digit = 0; digit < digitCount; ++digit)
+		{
+			const u32 digitOffset = offset;
+			for (u32 chunkIndex = 0; chunkIndex < chunks.chunkCount; ++chunkIndex)
+			{
+				u32&      histogramItem = buffers.histograms[chunkIndex * digitCount + digit];
+				const u32 itemCount     = histogramItem;
+				histogramItem           = offset;
+				offset += itemCount;
+			}
+			uniformDigit |= offset - digitOffset == count;
+		}
+
+		if (uniformDigit)
+		{
+			continue;
+		}
+
+		chunks.forEachChunk([&](u32 chunkIndex, u32 begin, u32 end) {
+			u32* writeOffsets = &buffers.histograms[chunkIndex * digitCount];
+
+			for (u32 i = begin; i < end; ++i)
+			{
+				const u32 writeIndex  = writeOffsets[(srcKeys[i] >> shift) & digitMask]++;
+				dstKeys[writeIndex]   = srcKeys[i];
+				dstValues[writeIndex] = srcValues[i];
+			}
+		});
+
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// Odd number of passes leaves the result in the temporary arrays
+	if (srcKeys != keys)
+	{
+		memcpy(keys, srcKeys, sizeof(u32) * count);
+		memcpy(values, srcValues, sizeof(u32) * count);
+	}
+}
+
 inline u32 interlockedIncrement(u32& x)
 {
 #ifdef _MSC_VER
@@ -147,6 +428,18 @@ inline u16 interlockedIncrement(u16& x)
 #endif
 }
 
+// Index of the lowest set bit, x must not be zero
+inline u32 findFirstSetBit(u32 x)
+{
+#ifdef _MSC_VER
+	unsigned long result;
+	_BitScanForward(&result, x);
+	return (u32)result;
+#else
+	return (u32)__builtin_ctz(x);
+#endif
+}
+
 template <typename T> struct AlignedArray
 {
 	AlignedArray(const AlignedArray&) = delete;
@@ -171,6 +464,13 @@ template <typename T> struct AlignedArray
 		rhs.m_count    = 0;
 	}
 
+	void swap(AlignedArray& rhs)
+	{
+		std::swap(m_data, rhs.m_data);
+		std::swap(m_capacity, rhs.m_capacity);
+		std::swap(m_count, rhs.m_count);
+	}
+
 	void resize(size_t newSize, size_t alignment = 16)
 	{
 		if (m_capacity < newSize)
@@ -202,27 +502,3 @@ template <typename T> struct AlignedArray
 	size_t m_capacity = 0;
 	size_t m_count    = 0;
 };
-
-template <typename ArrayType> u32 updateBufferFromArray(GfxContext* rc, GfxBuffer h, const ArrayType& data)
-{
-	u32 dataSize = (u32)(data.size() * sizeof(data[0]));
-	Gfx_UpdateBuffer(rc, h, data.data(), dataSize);
-	return dataSize;
-}
-
-GfxOwn<GfxTexture> loadDDS(const char* filename);
-GfxOwn<GfxTexture> loadBitmap(const char* filename, bool flipY = false);
-
-inline GfxOwn<GfxBuffer> Gfx_CreateConstantBuffer(GfxBufferFlags flags, u32 size, const void* data = nullptr)
-{
-	GfxBufferDesc desc(GfxBufferFlags::Constant | flags, GfxFormat_Unknown, 1, size);
-	return Gfx_CreateBuffer(desc, data);
-}
-
-inline GfxTextureData makeTextureData(const void* pixels, u32 mipLevel)
-{
-	GfxTextureData result;
-	result.pixels = pixels;
-	result.mip    = mipLevel;
-	return result;
-}